@@ -8,16 +8,27 @@ in vec3 f_barycentric;
 in vec3 f_triangle_normal;
 in float f_elevation;
 out vec4 outColor;
-uniform vec3 blinkingColor;
 uniform int isSelected;
 uniform int shadingMode;
-uniform vec3 backgroundColor;
-uniform float time;
 uniform int meshID;
-uniform float minElevation;
-uniform float maxElevation;
 uniform float vertexColorBlendAmount;
-uniform int DEBUG_VISUALS;
+
+// Per-frame state, filled once per frame from FrameUniforms in main.cpp.
+// Keep identical in every shader of the program.
+layout(std140) uniform FrameUniforms {
+    mat4 ViewMatrix;
+    mat4 ProjectionMatrix;
+    vec3 lightPosition_world;
+    float time;
+    vec3 blinkingColor;
+    float delta;
+    vec3 backgroundColor;
+    float minElevation;
+    float maxElevation;
+    int gridWidth; // vertices per terrain tile row
+    int DEBUG_VISUALS;
+    int gridHeight; // terrain tile rows
+};
 
 void main() {
     // Render wireframe
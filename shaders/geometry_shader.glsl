@@ -10,6 +10,7 @@ in vec3 v_normal_cameraSpace[];
 in vec3 v_eyeDirection_cameraSpace[];
 in vec3 v_lightDirection_cameraSpace[];
 in vec3 v_world_position[];
+in mat4 v_ModelMatrix[]; // per object or per instance
 
 // out int;
 out vec3 f_color;
@@ -21,12 +22,26 @@ out vec3 f_triangle_normal;
 out float f_elevation;
 out vec3 f_world_coord;
 // Uniforms
-uniform mat4 ModelMatrix;
-uniform mat4 ViewMatrix;
 uniform mat4 MirrorMatrix;
-uniform float minElevation;
 uniform int meshID;
 
+// Per-frame state, filled once per frame from FrameUniforms in main.cpp.
+// Keep identical in every shader of the program.
+layout(std140) uniform FrameUniforms {
+    mat4 ViewMatrix;
+    mat4 ProjectionMatrix;
+    vec3 lightPosition_world;
+    float time;
+    vec3 blinkingColor;
+    float delta;
+    vec3 backgroundColor;
+    float minElevation;
+    float maxElevation;
+    int gridWidth; // vertices per terrain tile row
+    int DEBUG_VISUALS;
+    int gridHeight; // terrain tile rows
+};
+
 // layout(triangles) out;
 // layout(triangles, max_vertices = 1) out;
 
@@ -40,11 +55,12 @@ void main() {
     vec3 triangle_normal = normalize(cross(e1.xyz, e2.xyz));
 
     f_triangle_normal =
-        (ViewMatrix * ModelMatrix * vec4(triangle_normal, 0.0)).xyz;
+        (ViewMatrix * v_ModelMatrix[0] * vec4(triangle_normal, 0.0)).xyz;
 
     for (int i = 0; i < 3; i++) {
         gl_Position = gl_in[i].gl_Position;
-        f_world_coord = (ViewMatrix * ModelMatrix * vec4(gl_Position)).xyz;
+        f_world_coord =
+            (ViewMatrix * v_ModelMatrix[i] * vec4(gl_Position)).xyz;
         f_color = v_color[i];
         f_normal_cameraSpace = v_normal_cameraSpace[i];
         f_eyeDirection_cameraSpace = v_eyeDirection_cameraSpace[i];
@@ -5,52 +5,166 @@ in vec3 mesh_0_vertexColor;
 in vec3 mesh_1_position;
 in vec3 mesh_1_vertexNormal;
 in vec3 mesh_1_vertexColor;
-in vec3 mesh_2_position;
-in vec3 mesh_2_vertexNormal;
-in vec3 mesh_2_vertexColor;
+// Per-instance values, only read when isInstanced is set
+in mat4 instance_ModelMatrix;
+in vec3 instance_color;
+in int instance_vertexOffset;
+in int instance_lodStep;
+in float instance_lodMorph;
 
 // Values that stay constant for the whole mesh.
 uniform mat4 MVPMatrix;
 uniform mat4 ModelMatrix;
-uniform mat4 ViewMatrix;
-uniform mat4 ProjectionMatrix;
 uniform mat4 MirrorMatrix;
-uniform vec3 lightPosition_world;
 uniform vec3 ModelColor;
 uniform int meshID;
-uniform float minElevation;
-uniform float maxElevation;
-uniform int DEBUG_VISUALS;
+// Meshes 0 and 1 may store positions quantized to their bounds (see
+// VertexFormat.h); position = attribute * positionScale + positionOffset
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
 uniform float vertexColorBlendAmount;
+uniform int isInstanced;
+uniform int vertexOffset; // first pool vertex of a terrain tile
+uniform int lodStep;      // terrain LOD grid step
+uniform float lodMorph;   // terrain LOD morph towards 2 * lodStep
+// Terrain tiles keep only heights and slopes, x/z come from gl_VertexID
+uniform samplerBuffer terrainHeights;
+uniform samplerBuffer terrainSlopes;
+// Clipmap levels keep toroidal heights and slopes, one texture layer each
+uniform sampler2DArray clipmapHeights;
+uniform sampler2DArray clipmapSlopes;
+uniform int clipmapSize;     // vertices per level row and column
+uniform ivec2 clipmapOrigin; // level grid coords of vertex 0
+uniform ivec2 clipmapWrap;   // texel of vertex 0, clipmapOrigin mod size
+uniform int clipmapScale;    // world units between the level's vertices
+uniform int clipmapLevel;    // texture layer of the level
+uniform float clipmapMorph;  // 1 blends the border into the next level
+
+// Per-frame state, filled once per frame from FrameUniforms in main.cpp.
+// Keep identical in every shader of the program.
+layout(std140) uniform FrameUniforms {
+    mat4 ViewMatrix;
+    mat4 ProjectionMatrix;
+    vec3 lightPosition_world;
+    float time;
+    vec3 blinkingColor;
+    float delta;
+    vec3 backgroundColor;
+    float minElevation;
+    float maxElevation;
+    int gridWidth; // vertices per terrain tile row
+    int DEBUG_VISUALS;
+    int gridHeight; // terrain tile rows
+};
 
 out vec3 v_color;
 out vec3 v_eyeDirection_cameraSpace;
 out vec3 v_normal_cameraSpace;
 out vec3 v_lightDirection_cameraSpace;
+out mat4 v_ModelMatrix;
 out int;
 
+float heightAt(int offset, int c, int r) {
+    return texelFetch(terrainHeights, offset + r * gridWidth + c).r;
+}
+
+// Height of (c, r) as drawn by the grid that keeps every lod_step-th row
+// and column. Mirrors HeightfieldMesh::lodHeight().
+float coarseHeight(int offset, int c, int r, int lod_step) {
+    int c0 = c / lod_step * lod_step;
+    int r0 = r / lod_step * lod_step;
+    int c1 = min(c0 + lod_step, gridWidth - 1);
+    int r1 = min(r0 + lod_step, gridHeight - 1);
+    float u = c1 > c0 ? float(c - c0) / float(c1 - c0) : 0.0;
+    float v = r1 > r0 ? float(r - r0) / float(r1 - r0) : 0.0;
+    float h00 = heightAt(offset, c0, r0);
+    float h01 = heightAt(offset, c1, r0);
+    float h10 = heightAt(offset, c0, r1);
+    float h11 = heightAt(offset, c1, r1);
+    if (u + v <= 1.0) {
+        return h00 + u * (h01 - h00) + v * (h10 - h00);
+    }
+    return h11 + (1.0 - u) * (h10 - h11) + (1.0 - v) * (h01 - h11);
+}
+
+// Height (x) and slope (yz) of level vertex (c, r)
+vec3 clipmapSample(int c, int r) {
+    ivec3 t = ivec3((clipmapWrap + ivec2(c, r)) % clipmapSize, clipmapLevel);
+    return vec3(texelFetch(clipmapHeights, t, 0).r,
+                texelFetch(clipmapSlopes, t, 0).rg);
+}
+
 void main() {
     vec3 vertexNormal;
     vec3 position;
     vec3 vertexColor;
+    mat4 model = ModelMatrix;
+    vec3 color = ModelColor;
+    int offset = vertexOffset;
+    int lod_step = lodStep;
+    float lod_morph = lodMorph;
+    mat4 mvp = MVPMatrix;
+    if (isInstanced == 1) {
+        model = instance_ModelMatrix;
+        color = instance_color;
+        offset = instance_vertexOffset;
+        lod_step = instance_lodStep;
+        lod_morph = instance_lodMorph;
+        mvp = ProjectionMatrix * ViewMatrix * model;
+    }
     // Position
     switch (meshID) {
     // Handle mesh ID 0
     case 0:
-        position = mesh_0_position;
+        position = mesh_0_position * positionScale + positionOffset;
         vertexNormal = mesh_0_vertexNormal;
         vertexColor = mesh_0_vertexColor;
         break;
     // Handle mesh ID 1
     case 1:
-        position = mesh_1_position;
+        position = mesh_1_position * positionScale + positionOffset;
         vertexNormal = mesh_1_vertexNormal;
         vertexColor = mesh_1_vertexColor;
         break;
     case 2:
-        position = mesh_2_position;
-        vertexNormal = mesh_2_vertexNormal;
-        vertexColor = mesh_2_vertexColor;
+        int c = gl_VertexID % gridWidth;
+        int r = gl_VertexID / gridWidth;
+        float h = heightAt(offset, c, r);
+        // Fade interior vertices towards the next LOD level; edge vertices
+        // stay put so seams with neighbouring tiles stay closed
+        if (lod_morph > 0.0 && c > 0 && r > 0 && c < gridWidth - 1 &&
+            r < gridHeight - 1) {
+            h = mix(h, coarseHeight(offset, c, r, lod_step * 2), lod_morph);
+        }
+        position = vec3(c, h, r);
+        vec2 slope = texelFetch(terrainSlopes, offset + gl_VertexID).rg;
+        vertexNormal = normalize(vec3(-slope.x, 1.0, -slope.y));
+        vertexColor = vec3(0.0);
+        break;
+    case 3:
+        int cc = gl_VertexID % clipmapSize;
+        int cr = gl_VertexID / clipmapSize;
+        vec3 s = clipmapSample(cc, cr);
+        // Towards the border, blend into the next coarser level. The origin
+        // is even, so odd vertices sit mid-edge of its triangles (same
+        // diagonal as the grid) and end up exactly on them.
+        float half_size = float(clipmapSize / 2);
+        float width = float(clipmapSize) / 10.0;
+        float border =
+            max(abs(float(cc) - half_size), abs(float(cr) - half_size));
+        float alpha = clipmapMorph *
+                      clamp((border - (half_size - width)) / width, 0.0, 1.0);
+        if (alpha > 0.0) {
+            int dc = cc % 2;
+            int dr = cr % 2;
+            vec3 coarse = 0.5 * (clipmapSample(cc - dc, cr + dr) +
+                                 clipmapSample(cc + dc, cr - dr));
+            s = mix(s, coarse, alpha);
+        }
+        vec2 xz = vec2(clipmapOrigin + ivec2(cc, cr)) * float(clipmapScale);
+        position = vec3(xz.x, s.x, xz.y);
+        vertexNormal = normalize(vec3(-s.y, 1.0, -s.z));
+        vertexColor = vec3(0.0);
         break;
     default:
         // position = mesh_0_position;
@@ -59,16 +173,17 @@ void main() {
         break;
     }
 
-    gl_Position = MVPMatrix * vec4(position, 1.0);
-    v_color = ModelColor + (vertexColor * vertexColorBlendAmount);
+    gl_Position = mvp * vec4(position, 1.0);
+    v_color = color + (vertexColor * vertexColorBlendAmount);
+    v_ModelMatrix = model;
 
     // Normals / lighting
 
     // Position of the vertex, in worldspace : M * position
-    vec3 v_world_position = (ModelMatrix * vec4(position, 1.0)).xyz;
+    vec3 v_world_position = (model * vec4(position, 1.0)).xyz;
 
     // // // Set terrain color based on elevation
-    if (meshID == 2) {
+    if (meshID == 2 || meshID == 3) {
         if (DEBUG_VISUALS == 0) {
             if (v_world_position.y <= minElevation) {
                 v_color = vec3(0.1, 0.1, 0.78); // BLUE
@@ -95,5 +210,5 @@ void main() {
 
     // Vertex normal in camera space
     v_normal_cameraSpace =
-        (ViewMatrix * ModelMatrix * vec4(vertexNormal, 0.0)).xyz;
+        (ViewMatrix * model * vec4(vertexNormal, 0.0)).xyz;
 }
\ No newline at end of file
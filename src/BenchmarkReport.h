@@ -0,0 +1,235 @@
+#pragma once
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <Culling.h>
+#include <DrawStats.h>
+#include <FrameTimings.h>
+
+/*
+    Frame times of a run, split into the CPU time of each stage of the
+    frame loop, written out as JSON so runs (typically replays of the same
+    CameraPath) can be compared by a script.
+
+    Per frame: startFrame(), lap() after each stage with the stage it ends
+    (a stage may be lapped more than once a frame, the times add up), then
+    endFrame(). Frame time is wall-clock from startFrame() to endFrame().
+
+    A tile hitch is a frame that uploaded terrain tiles and took more than
+    HITCH_FACTOR times the median frame.
+
+    GPU pass times come from addGpuTime() whenever a pass's timer query is
+    read back, a few frames late, so they are summarized on their own.
+*/
+class BenchmarkReport {
+  public:
+    enum Subsystem {
+        INPUT = 0,          // key handling or replay
+        TERRAIN_UPLOAD = 1, // swapping in tiles built by workers
+        CULLING = 2,
+        TERRAIN_LOD = 3,
+        DRAW = 4,    // frame setup and draw submission
+        PRESENT = 5, // buffer swap, or glFinish when headless
+        NUM_SUBSYSTEMS = 6
+    };
+    static constexpr float HITCH_FACTOR = 2.0f;
+
+    static const char *name(int subsystem) {
+        static const char *NAMES[NUM_SUBSYSTEMS] = {
+            "input", "terrain_upload", "culling", "terrain_lod", "draw",
+            "present"};
+        return NAMES[subsystem];
+    }
+
+  private:
+    typedef std::chrono::high_resolution_clock Clock;
+
+    FrameTimings frame_timings;
+    FrameTimings subsystem_timings[NUM_SUBSYSTEMS];
+    std::vector<unsigned int> tiles_uploaded; // per frame
+    FrameTimings draw_calls;                  // per frame, as counts
+    FrameTimings triangles;
+    FrameTimings objects_drawn; // scene objects left after culling
+    FrameTimings objects_culled;
+    FrameTimings tiles_resident;
+    // Per GPU pass, in the order passes were first reported
+    std::vector<std::pair<std::string, FrameTimings>> gpu_timings;
+    float frame_subsystem_ms[NUM_SUBSYSTEMS];
+    Clock::time_point frame_start;
+    Clock::time_point lap_start;
+
+    // Filled in by setTileBuilds(), from the terrain's workers
+    unsigned long tiles_built = 0;
+    double tile_build_total_ms = 0.0;
+    double tile_build_max_ms = 0.0;
+
+    static float msSince(Clock::time_point t) {
+        return std::chrono::duration<float, std::milli>(Clock::now() - t)
+            .count();
+    }
+
+  public:
+    void startFrame() {
+        frame_start = lap_start = Clock::now();
+        for (int s = 0; s < NUM_SUBSYSTEMS; s++) {
+            frame_subsystem_ms[s] = 0.0f;
+        }
+    }
+
+    void lap(int subsystem) {
+        Clock::time_point now = Clock::now();
+        frame_subsystem_ms[subsystem] +=
+            std::chrono::duration<float, std::milli>(now - lap_start).count();
+        lap_start = now;
+    }
+
+    void endFrame(unsigned int num_tiles_uploaded, const DrawStats &draws,
+                  const CullStats &culling, unsigned int num_tiles_resident) {
+        frame_timings.add(msSince(frame_start));
+        for (int s = 0; s < NUM_SUBSYSTEMS; s++) {
+            subsystem_timings[s].add(frame_subsystem_ms[s]);
+        }
+        tiles_uploaded.push_back(num_tiles_uploaded);
+        draw_calls.add((float)draws.draw_calls);
+        triangles.add((float)draws.triangles);
+        objects_drawn.add((float)culling.drawn);
+        objects_culled.add((float)culling.culled);
+        tiles_resident.add((float)num_tiles_resident);
+    }
+
+    void addGpuTime(const std::string &pass, float ms) {
+        for (auto &timings : gpu_timings) {
+            if (timings.first == pass) {
+                timings.second.add(ms);
+                return;
+            }
+        }
+        gpu_timings.emplace_back(pass, FrameTimings());
+        gpu_timings.back().second.add(ms);
+    }
+
+    void setTileBuilds(unsigned long built, double total_ms, double max_ms) {
+        tiles_built = built;
+        tile_build_total_ms = total_ms;
+        tile_build_max_ms = max_ms;
+    }
+
+    const FrameTimings &frames() const { return frame_timings; }
+
+    float hitchThresholdMs() const {
+        return HITCH_FACTOR * frame_timings.percentile(50);
+    }
+
+    // Frames that uploaded tiles and went over hitchThresholdMs()
+    std::vector<size_t> tileHitches() const {
+        std::vector<size_t> hitches;
+        float threshold = hitchThresholdMs();
+        for (size_t i = 0; i < frame_timings.count(); i++) {
+            if (tiles_uploaded[i] > 0 && frame_timings[i] > threshold) {
+                hitches.push_back(i);
+            }
+        }
+        return hitches;
+    }
+
+    // source names what was run, e.g. the replayed path
+    bool writeJson(const std::string &path, const std::string &source,
+                   int width, int height) const {
+        std::ofstream out(path);
+        if (!out) {
+            std::cout << "BenchmarkReport: could not write " << path
+                      << std::endl;
+            return false;
+        }
+        out << std::fixed << std::setprecision(3);
+        out << "{\n";
+        out << "  \"source\": \"" << escape(source) << "\",\n";
+        out << "  \"width\": " << width << ",\n";
+        out << "  \"height\": " << height << ",\n";
+        out << "  \"frames\": " << frame_timings.count() << ",\n";
+        out << "  \"total_s\": " << frame_timings.total() / 1000.0f << ",\n";
+        out << "  \"frame_ms\": ";
+        writeSummary(out, frame_timings);
+        out << ",\n";
+
+        out << "  \"cpu_ms\": {\n";
+        for (int s = 0; s < NUM_SUBSYSTEMS; s++) {
+            out << "    \"" << name(s) << "\": ";
+            writeSummary(out, subsystem_timings[s]);
+            out << (s + 1 < NUM_SUBSYSTEMS ? ",\n" : "\n");
+        }
+        out << "  },\n";
+
+        out << "  \"gpu_ms\": {";
+        for (size_t p = 0; p < gpu_timings.size(); p++) {
+            out << (p > 0 ? ",\n" : "\n") << "    \"" << gpu_timings[p].first
+                << "\": ";
+            writeSummary(out, gpu_timings[p].second);
+        }
+        out << (gpu_timings.empty() ? "},\n" : "\n  },\n");
+        out << "  \"draw_calls\": ";
+        writeSummary(out, draw_calls);
+        out << ",\n";
+        out << "  \"triangles\": ";
+        writeSummary(out, triangles);
+        out << ",\n";
+        out << "  \"objects_drawn\": ";
+        writeSummary(out, objects_drawn);
+        out << ",\n";
+        out << "  \"objects_culled\": ";
+        writeSummary(out, objects_culled);
+        out << ",\n";
+        out << "  \"tiles_resident\": ";
+        writeSummary(out, tiles_resident);
+        out << ",\n";
+
+        unsigned long uploaded = 0;
+        for (unsigned int n : tiles_uploaded) {
+            uploaded += n;
+        }
+        out << "  \"tiles\": {\"built\": " << tiles_built
+            << ", \"uploaded\": " << uploaded
+            << ", \"build_ms_total\": " << tile_build_total_ms
+            << ", \"build_ms_max\": " << tile_build_max_ms << "},\n";
+
+        std::vector<size_t> hitches = tileHitches();
+        out << "  \"tile_hitches\": {\"threshold_ms\": " << hitchThresholdMs()
+            << ", \"count\": " << hitches.size() << ", \"frames\": [";
+        for (size_t i = 0; i < hitches.size(); i++) {
+            size_t f = hitches[i];
+            out << (i > 0 ? ", " : "") << "{\"frame\": " << f
+                << ", \"ms\": " << frame_timings[f]
+                << ", \"tiles_uploaded\": " << tiles_uploaded[f]
+                << ", \"terrain_upload_ms\": "
+                << subsystem_timings[TERRAIN_UPLOAD][f] << "}";
+        }
+        out << "]}\n";
+        out << "}\n";
+        return (bool)out;
+    }
+
+  private:
+    static void writeSummary(std::ostream &out, const FrameTimings &t) {
+        out << "{\"mean\": " << t.mean() << ", \"p50\": " << t.percentile(50)
+            << ", \"p95\": " << t.percentile(95)
+            << ", \"p99\": " << t.percentile(99) << ", \"max\": " << t.max()
+            << ", \"total\": " << t.total() << "}";
+    }
+
+    static std::string escape(const std::string &s) {
+        std::string escaped;
+        for (char c : s) {
+            if (c == '"' || c == '\\') {
+                escaped += '\\';
+            }
+            escaped += c;
+        }
+        return escaped;
+    }
+};
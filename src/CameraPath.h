@@ -0,0 +1,98 @@
+#pragma once
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Everything one frame's view depends on, as --record saves it
+struct CameraPathFrame {
+    glm::vec3 player_position;
+    float player_rotation;
+    float player_elevation; // the player's elevation_offset
+    glm::vec3 camera_position;
+    glm::vec3 light_position;
+    float zoom;
+    float sky_lighting;
+    int is_pixelated; // secondary (pixelating) renderer on
+    float pixel_width;
+};
+
+/*
+    A recorded flythrough: the player and camera state of every frame.
+
+    Replaying sets each frame's state directly instead of feeding keys back
+    in, so a replay shows the same frames whatever the frame rate (keys only
+    fire every KEY_PRESS_THROTTLE_FRAMES) and whatever machine it runs on.
+
+    Stored as text, one frame per line after a version line, with floats
+    written in full precision so a replay is exact.
+*/
+class CameraPath {
+  public:
+    static const int VERSION = 1;
+
+    std::vector<CameraPathFrame> frames;
+
+    bool save(const std::string &path) const {
+        std::ofstream out(path);
+        if (!out) {
+            std::cout << "CameraPath: could not write " << path << std::endl;
+            return false;
+        }
+        out << "infinityterrain-path " << VERSION << "\n";
+        out << std::setprecision(9);
+        for (const CameraPathFrame &f : frames) {
+            out << f.player_position.x << " " << f.player_position.y << " "
+                << f.player_position.z << " " << f.player_rotation << " "
+                << f.player_elevation << " " << f.camera_position.x << " "
+                << f.camera_position.y << " " << f.camera_position.z << " "
+                << f.light_position.x << " " << f.light_position.y << " "
+                << f.light_position.z << " " << f.zoom << " "
+                << f.sky_lighting << " " << f.is_pixelated << " "
+                << f.pixel_width << "\n";
+        }
+        return (bool)out;
+    }
+
+    bool load(const std::string &path) {
+        std::ifstream in(path);
+        std::string magic;
+        int version = 0;
+        if (!(in >> magic >> version) || magic != "infinityterrain-path" ||
+            version != VERSION) {
+            std::cout << "CameraPath: " << path << " is not a version "
+                      << VERSION << " path" << std::endl;
+            return false;
+        }
+        frames.clear();
+        std::string line;
+        std::getline(in, line); // rest of the version line
+        while (std::getline(in, line)) {
+            if (line.empty()) {
+                continue;
+            }
+            std::istringstream fields(line);
+            CameraPathFrame f;
+            if (!(fields >> f.player_position.x >> f.player_position.y >>
+                  f.player_position.z >> f.player_rotation >>
+                  f.player_elevation >> f.camera_position.x >>
+                  f.camera_position.y >> f.camera_position.z >>
+                  f.light_position.x >> f.light_position.y >>
+                  f.light_position.z >> f.zoom >> f.sky_lighting >>
+                  f.is_pixelated >> f.pixel_width)) {
+                std::cout << "CameraPath: bad frame " << frames.size()
+                          << " in " << path << std::endl;
+                return false;
+            }
+            frames.push_back(f);
+        }
+        std::cout << "CameraPath: " << frames.size() << " frames from "
+                  << path << std::endl;
+        return true;
+    }
+};
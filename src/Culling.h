@@ -0,0 +1,172 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Same lane selection as Noise.h: 8 spheres per test with AVX2, 4 with SSE2
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CULL_SIMD_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CULL_SIMD_SSE2 1
+#endif
+
+struct CullStats {
+    unsigned int tested = 0;
+    unsigned int culled = 0;
+    unsigned int drawn = 0;
+};
+
+// The six planes (ax + by + cz + d >= 0 inside) of a view-projection
+struct Frustum {
+    glm::vec4 planes[6];
+
+    // Gribb/Hartmann extraction, normalized so plane distances are in
+    // world units and can be compared against sphere radii
+    static Frustum fromMatrix(const glm::mat4 &vp) {
+        Frustum f;
+        glm::vec4 row[4];
+        for (int i = 0; i < 4; i++) {
+            row[i] = glm::vec4(vp[0][i], vp[1][i], vp[2][i], vp[3][i]);
+        }
+        f.planes[0] = row[3] + row[0]; // left
+        f.planes[1] = row[3] - row[0]; // right
+        f.planes[2] = row[3] + row[1]; // bottom
+        f.planes[3] = row[3] - row[1]; // top
+        f.planes[4] = row[3] + row[2]; // near
+        f.planes[5] = row[3] - row[2]; // far
+        for (int i = 0; i < 6; i++) {
+            f.planes[i] /= glm::length(glm::vec3(f.planes[i]));
+        }
+        return f;
+    }
+};
+
+/*
+    Tests bounding spheres against a frustum, several spheres per SIMD op.
+
+    Spheres are kept as structure-of-arrays (x, y, z, radius) padded to the
+    lane count, so each plane is evaluated for 4 or 8 spheres with one
+    multiply-add chain and compare. A sphere is visible unless it lies
+    entirely behind one of the planes.
+
+    Usage, every frame: clear(), add() each object's world space sphere,
+    cull().
+*/
+class SphereCuller {
+  private:
+    std::vector<float> xs;
+    std::vector<float> ys;
+    std::vector<float> zs;
+    std::vector<float> rs;
+    size_t count = 0;
+
+#if defined(CULL_SIMD_AVX2)
+    static const int LANES = 8;
+#elif defined(CULL_SIMD_SSE2)
+    static const int LANES = 4;
+#else
+    static const int LANES = 1;
+#endif
+
+  public:
+    void clear() {
+        count = 0;
+        xs.clear();
+        ys.clear();
+        zs.clear();
+        rs.clear();
+    }
+
+    void add(glm::vec3 center, float radius) {
+        xs.push_back(center.x);
+        ys.push_back(center.y);
+        zs.push_back(center.z);
+        rs.push_back(radius);
+        count++;
+    }
+
+    size_t size() { return count; }
+
+    // Sets visible[i] to 1 when sphere i may be seen, 0 when it is culled
+    CullStats cull(const Frustum &f, std::vector<unsigned char> &visible) {
+        // Pad to whole lanes with spheres that are always visible
+        size_t padded = (count + LANES - 1) / LANES * LANES;
+        xs.resize(padded, 0.0f);
+        ys.resize(padded, 0.0f);
+        zs.resize(padded, 0.0f);
+        rs.resize(padded, 1e30f);
+        visible.assign(padded, 1);
+
+        for (size_t i = 0; i < padded; i += LANES) {
+            int mask = visibleMask(f, i);
+            for (int l = 0; l < LANES; l++) {
+                visible[i + l] = (mask >> l) & 1;
+            }
+        }
+        visible.resize(count);
+        xs.resize(count);
+        ys.resize(count);
+        zs.resize(count);
+        rs.resize(count);
+
+        CullStats stats;
+        stats.tested = count;
+        for (size_t i = 0; i < count; i++) {
+            stats.drawn += visible[i];
+        }
+        stats.culled = stats.tested - stats.drawn;
+        return stats;
+    }
+
+  private:
+    // Bit l set when sphere i + l is in front of or straddles every plane
+    int visibleMask(const Frustum &f, size_t i) {
+#if defined(CULL_SIMD_AVX2)
+        __m256 x = _mm256_loadu_ps(&xs[i]);
+        __m256 y = _mm256_loadu_ps(&ys[i]);
+        __m256 z = _mm256_loadu_ps(&zs[i]);
+        __m256 neg_r =
+            _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&rs[i]));
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int p = 0; p < 6; p++) {
+            const glm::vec4 &pl = f.planes[p];
+            __m256 d = _mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(pl.x)),
+                              _mm256_mul_ps(y, _mm256_set1_ps(pl.y))),
+                _mm256_add_ps(_mm256_mul_ps(z, _mm256_set1_ps(pl.z)),
+                              _mm256_set1_ps(pl.w)));
+            inside =
+                _mm256_and_ps(inside, _mm256_cmp_ps(d, neg_r, _CMP_GE_OQ));
+        }
+        return _mm256_movemask_ps(inside);
+#elif defined(CULL_SIMD_SSE2)
+        __m128 x = _mm_loadu_ps(&xs[i]);
+        __m128 y = _mm_loadu_ps(&ys[i]);
+        __m128 z = _mm_loadu_ps(&zs[i]);
+        __m128 neg_r = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&rs[i]));
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int p = 0; p < 6; p++) {
+            const glm::vec4 &pl = f.planes[p];
+            __m128 d =
+                _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(pl.x)),
+                                      _mm_mul_ps(y, _mm_set1_ps(pl.y))),
+                           _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(pl.z)),
+                                      _mm_set1_ps(pl.w)));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, neg_r));
+        }
+        return _mm_movemask_ps(inside);
+#else
+        for (int p = 0; p < 6; p++) {
+            const glm::vec4 &pl = f.planes[p];
+            float d = xs[i] * pl.x + ys[i] * pl.y + zs[i] * pl.z + pl.w;
+            if (d < -rs[i]) {
+                return 0;
+            }
+        }
+        return 1;
+#endif
+    }
+};
@@ -0,0 +1,13 @@
+#pragma once
+
+// What a frame submitted to the GPU, counted at its draw calls
+struct DrawStats {
+    unsigned int draw_calls = 0;
+    unsigned long triangles = 0;
+
+    // One draw call of num_indices triangle indices, instanced or not
+    void add(unsigned long num_indices, unsigned long instances = 1) {
+        draw_calls++;
+        triangles += num_indices / 3 * instances;
+    }
+};
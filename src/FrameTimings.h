@@ -0,0 +1,59 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+/*
+    Wall-clock time of every frame of a run, in milliseconds, summarized as
+    the mean and nearest-rank percentiles.
+*/
+class FrameTimings {
+  private:
+    std::vector<float> frame_ms;
+
+  public:
+    void add(float ms) { frame_ms.push_back(ms); }
+    size_t count() const { return frame_ms.size(); }
+    float operator[](size_t frame) const { return frame_ms[frame]; }
+
+    float total() const {
+        double sum = 0.0;
+        for (float ms : frame_ms) {
+            sum += ms;
+        }
+        return (float)sum;
+    }
+
+    float mean() const { return frame_ms.empty() ? 0.0f : total() / count(); }
+
+    // Smallest frame time at or above p percent of the frames
+    float percentile(float p) const {
+        if (frame_ms.empty()) {
+            return 0.0f;
+        }
+        std::vector<float> sorted(frame_ms);
+        size_t rank = (size_t)std::ceil(p / 100.0f * sorted.size());
+        rank = std::min(std::max(rank, (size_t)1), sorted.size());
+        std::nth_element(sorted.begin(), sorted.begin() + rank - 1,
+                         sorted.end());
+        return sorted[rank - 1];
+    }
+
+    float max() const {
+        return frame_ms.empty()
+                   ? 0.0f
+                   : *std::max_element(frame_ms.begin(), frame_ms.end());
+    }
+};
+
+inline std::ostream &operator<<(std::ostream &os, const FrameTimings &t) {
+    float mean = t.mean();
+    return os << "Frames: " << t.count() << " in " << t.total() / 1000.0f
+              << " s, mean " << mean << " ms ("
+              << (mean > 0.0f ? 1000.0f / mean : 0.0f) << " fps), p50 "
+              << t.percentile(50) << " ms, p95 " << t.percentile(95)
+              << " ms, p99 " << t.percentile(99) << " ms, max " << t.max()
+              << " ms";
+}
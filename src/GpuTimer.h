@@ -0,0 +1,127 @@
+#pragma once
+
+#include <iostream>
+
+#include "lib/Helpers.h"
+
+/*
+    GPU time of each render pass of a frame, from GL_TIME_ELAPSED queries.
+
+    Queries are double buffered: the queries a frame issues are read back
+    when their set comes round again two frames later, and only if the GPU
+    already has the results (GL_QUERY_RESULT_AVAILABLE), so reading them
+    never stalls the pipeline. Results that are not ready by then are
+    dropped and the pass keeps its last time; a pass that was not drawn
+    reads 0.
+
+    Elapsed-time queries cannot nest, so passes must not overlap.
+
+    Usage, every frame: startFrame(), then begin(pass) / end() around each
+    pass drawn. ms() is the pass's latest time, hasResult() whether it was
+    read back this frame.
+
+    Timer queries need GL 3.3 or ARB_timer_query; without them init() fails
+    and every pass reads 0.
+*/
+class GpuTimer {
+  public:
+    enum Pass {
+        TERRAIN = 0, // main pass: clear, instanced tiles and clipmap
+        OBJECTS = 1, // main pass: per-object draws (player, meshes)
+        POST = 2,    // quad_program post-processing pass
+        NUM_PASSES = 3
+    };
+    static const int NUM_SETS = 2;
+
+    static const char *name(int pass) {
+        static const char *NAMES[NUM_PASSES] = {"terrain", "objects", "post"};
+        return NAMES[pass];
+    }
+
+  private:
+    GLuint queries[NUM_SETS][NUM_PASSES];
+    bool is_issued[NUM_SETS][NUM_PASSES];
+    int current = 0;
+    int active = -1; // pass being timed, or -1
+    bool is_supported = false;
+    float pass_ms[NUM_PASSES];
+    bool has_result[NUM_PASSES];
+
+  public:
+    // has_timer_query: whether the context offers timer queries
+    bool init(bool has_timer_query) {
+        for (int p = 0; p < NUM_PASSES; p++) {
+            pass_ms[p] = 0.0f;
+            has_result[p] = false;
+            for (int s = 0; s < NUM_SETS; s++) {
+                is_issued[s][p] = false;
+            }
+        }
+#ifndef __APPLE__
+        // GLEW leaves the entry point unset when the driver lacks it
+        has_timer_query = has_timer_query && glGetQueryObjectui64v != nullptr;
+#endif
+        if (!has_timer_query) {
+            std::cout << "GpuTimer: no timer queries, GPU times read 0"
+                      << std::endl;
+            return false;
+        }
+        glGenQueries(NUM_SETS * NUM_PASSES, &queries[0][0]);
+        is_supported = true;
+        return true;
+    }
+
+    // Reads back the set issued NUM_SETS frames ago, then reuses it
+    void startFrame() {
+        if (!is_supported) {
+            return;
+        }
+        current = (current + 1) % NUM_SETS;
+        for (int p = 0; p < NUM_PASSES; p++) {
+            has_result[p] = false;
+            if (!is_issued[current][p]) {
+                pass_ms[p] = 0.0f; // not drawn that frame
+                continue;
+            }
+            is_issued[current][p] = false;
+            GLint is_available = 0;
+            glGetQueryObjectiv(queries[current][p], GL_QUERY_RESULT_AVAILABLE,
+                               &is_available);
+            if (!is_available) {
+                continue;
+            }
+            GLuint64 elapsed_ns = 0;
+            glGetQueryObjectui64v(queries[current][p], GL_QUERY_RESULT,
+                                  &elapsed_ns);
+            pass_ms[p] = (float)(elapsed_ns / 1.0e6);
+            has_result[p] = true;
+        }
+    }
+
+    void begin(int pass) {
+        if (!is_supported) {
+            return;
+        }
+        glBeginQuery(GL_TIME_ELAPSED, queries[current][pass]);
+        is_issued[current][pass] = true;
+        active = pass;
+    }
+
+    void end() {
+        if (!is_supported || active < 0) {
+            return;
+        }
+        glEndQuery(GL_TIME_ELAPSED);
+        active = -1;
+    }
+
+    float ms(int pass) const { return pass_ms[pass]; }
+    bool hasResult(int pass) const { return has_result[pass]; }
+
+    void free() {
+        if (is_supported) {
+            glDeleteQueries(NUM_SETS * NUM_PASSES, &queries[0][0]);
+            is_supported = false;
+        }
+    }
+};
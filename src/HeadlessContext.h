@@ -0,0 +1,181 @@
+#pragma once
+
+#include <cstring>
+#include <iostream>
+
+#include "lib/Helpers.h"
+
+#ifdef USE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+/*
+    An OpenGL 3.2 core context with no window, for --headless runs on
+    machines without a display (or a GPU, through Mesa's llvmpipe).
+
+    The context comes from EGL on Mesa's surfaceless platform when the
+    driver offers it, else from the default display; it is made current
+    without a surface (EGL_KHR_surfaceless_context) or, failing that, with a
+    1x1 pbuffer that is never drawn to. Frames go to framebuffer(), an FBO of
+    the requested size, in place of the window's default framebuffer.
+
+    Needs a build with EGL (USE_EGL, set by CMake when libEGL is found);
+    without it init() reports the missing support and fails.
+*/
+class HeadlessContext {
+  private:
+#ifdef USE_EGL
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+    EGLSurface surface = EGL_NO_SURFACE;
+#endif
+    GLuint fbo = 0;
+    GLuint color_buffer = 0;
+    GLuint depth_buffer = 0;
+
+  public:
+    int width = 0;
+    int height = 0;
+
+    // Creates the context and makes it current. GL functions are usable
+    // once GLEW is initialized on top of it.
+    bool init(int _width, int _height) {
+        width = _width;
+        height = _height;
+#ifdef USE_EGL
+        const char *client_extensions =
+            eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress(
+                "eglGetPlatformDisplayEXT");
+        if (client_extensions != nullptr && getPlatformDisplay != nullptr &&
+            strstr(client_extensions, "EGL_MESA_platform_surfaceless")) {
+            display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                         EGL_DEFAULT_DISPLAY, nullptr);
+        }
+        if (display == EGL_NO_DISPLAY) {
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        }
+        EGLint major, minor;
+        if (display == EGL_NO_DISPLAY ||
+            !eglInitialize(display, &major, &minor)) {
+            std::cout << "Headless: no EGL display" << std::endl;
+            return false;
+        }
+        if (!eglBindAPI(EGL_OPENGL_API)) {
+            std::cout << "Headless: EGL has no desktop OpenGL" << std::endl;
+            return false;
+        }
+
+        const EGLint config_attributes[] = {EGL_SURFACE_TYPE,
+                                            EGL_PBUFFER_BIT,
+                                            EGL_RENDERABLE_TYPE,
+                                            EGL_OPENGL_BIT,
+                                            EGL_RED_SIZE,
+                                            8,
+                                            EGL_GREEN_SIZE,
+                                            8,
+                                            EGL_BLUE_SIZE,
+                                            8,
+                                            EGL_DEPTH_SIZE,
+                                            24,
+                                            EGL_NONE};
+        EGLConfig config;
+        EGLint num_configs = 0;
+        if (!eglChooseConfig(display, config_attributes, &config, 1,
+                             &num_configs) ||
+            num_configs == 0) {
+            std::cout << "Headless: no EGL config for OpenGL" << std::endl;
+            return false;
+        }
+
+        // The same 3.2 core context the windowed path asks GLFW for
+        const EGLint context_attributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION_KHR,
+            3,
+            EGL_CONTEXT_MINOR_VERSION_KHR,
+            2,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR,
+            EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+            EGL_NONE};
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT,
+                                   context_attributes);
+        if (context == EGL_NO_CONTEXT) {
+            std::cout << "Headless: could not create a 3.2 core context"
+                      << std::endl;
+            return false;
+        }
+
+        const char *display_extensions =
+            eglQueryString(display, EGL_EXTENSIONS);
+        if (display_extensions == nullptr ||
+            !strstr(display_extensions, "EGL_KHR_surfaceless_context")) {
+            const EGLint pbuffer_attributes[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1,
+                                                 EGL_NONE};
+            surface =
+                eglCreatePbufferSurface(display, config, pbuffer_attributes);
+        }
+        if (!eglMakeCurrent(display, surface, surface, context)) {
+            std::cout << "Headless: could not make the context current"
+                      << std::endl;
+            return false;
+        }
+        std::cout << "Headless: EGL " << major << "." << minor << ", "
+                  << eglQueryString(display, EGL_VENDOR) << std::endl;
+        return true;
+#else
+        std::cout << "Headless: this build has no EGL support" << std::endl;
+        return false;
+#endif
+    }
+
+    // Creates the FBO frames are drawn to. Needs GLEW.
+    bool initFramebuffer() {
+        glGenRenderbuffers(1, &color_buffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, color_buffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glGenRenderbuffers(1, &depth_buffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth_buffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width,
+                              height);
+
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                  GL_RENDERBUFFER, color_buffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                  GL_RENDERBUFFER, depth_buffer);
+        return glCheckFramebufferStatus(GL_FRAMEBUFFER) ==
+               GL_FRAMEBUFFER_COMPLETE;
+    }
+
+    GLuint framebuffer() const { return fbo; }
+
+    // Stands in for the buffer swap: waits for the frame to finish, so
+    // frame times include the GPU (or llvmpipe) work
+    void finishFrame() { glFinish(); }
+
+    void free() {
+        if (fbo != 0) {
+            glDeleteFramebuffers(1, &fbo);
+            glDeleteRenderbuffers(1, &color_buffer);
+            glDeleteRenderbuffers(1, &depth_buffer);
+            fbo = 0;
+        }
+#ifdef USE_EGL
+        if (display != EGL_NO_DISPLAY) {
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                           EGL_NO_CONTEXT);
+            if (surface != EGL_NO_SURFACE) {
+                eglDestroySurface(display, surface);
+            }
+            if (context != EGL_NO_CONTEXT) {
+                eglDestroyContext(display, context);
+            }
+            eglTerminate(display);
+            display = EGL_NO_DISPLAY;
+        }
+#endif
+    }
+};
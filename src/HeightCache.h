@@ -0,0 +1,215 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <TileArchive.h>
+
+struct HeightCacheStats {
+    unsigned long hits = 0;
+    unsigned long misses = 0;
+    unsigned long archive_hits = 0; // misses served from the tile archive
+    unsigned long evictions = 0;
+    size_t resident_tiles = 0;
+    size_t resident_bytes = 0;
+    size_t budget_bytes = 0;
+};
+
+inline std::ostream &operator<<(std::ostream &os, const HeightCacheStats &s) {
+    unsigned long lookups = s.hits + s.misses;
+    double hit_rate = lookups > 0 ? 100.0 * s.hits / lookups : 0.0;
+    return os << "HeightCache: hits=" << s.hits << " misses=" << s.misses
+              << " (" << hit_rate << "% hit)"
+              << " archived=" << s.archive_hits
+              << " evictions=" << s.evictions
+              << " tiles=" << s.resident_tiles << " bytes=" << s.resident_bytes
+              << "/" << s.budget_bytes;
+}
+
+/*
+    Sparse LRU cache of terrain heightfields keyed by world tile cell.
+
+    A tile holds the w x h vertex heights of one grid cell, followed by the
+    (dh/dx, dh/dz) slope of every vertex, so tile builds get both streams
+    from the cache (or the archive) without sampling noise. Neighbouring
+    cells share their edge vertices, so cell (cx, cy) starts at world vertex
+    (cx * (w - 1), cy * (h - 1)). Tiles are generated on demand through the
+    generator callback. The least recently used tiles are evicted once the
+    resident size passes the memory budget, so memory stays flat no matter
+    how far the player roams.
+
+    With a TileArchive attached, misses are served straight from the
+    memory-mapped archive before falling back to the generator, and newly
+    generated tiles are appended to it.
+
+    Lookups are thread safe. Tiles are handed out as shared pointers, so a
+    tile evicted while a caller still reads it stays alive until released.
+    Archived tiles point into the mapping, which must outlive the cache.
+*/
+class HeightTileCache {
+  public:
+    // tile_w * tile_h heights, then tile_w * tile_h slope pairs
+    typedef std::shared_ptr<const float> Tile;
+
+  private:
+    struct Entry {
+        glm::ivec2 cell;
+        Tile heights;
+    };
+
+    std::mutex mutex;
+    std::list<Entry> lru; // most recently used at the front
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> entries;
+    unsigned int tile_w;
+    unsigned int tile_h;
+    size_t budget_bytes;
+    HeightCacheStats counters;
+    TileArchive *archive;
+    // Fills heights[0..w*h) and slopes[0..w*h*2) of cell, row-major
+    void (*generator)(glm::ivec2 cell, unsigned int w, unsigned int h,
+                      float *heights, float *slopes);
+
+    static uint64_t key(glm::ivec2 cell) {
+        return ((uint64_t)(uint32_t)cell.x << 32) | (uint32_t)cell.y;
+    }
+
+    // Integer division rounding towards -inf (b > 0)
+    static int floorDiv(int a, int b) {
+        return a >= 0 ? a / b : -((-a + b - 1) / b);
+    }
+
+    // Called with mutex held
+    void evictOverBudget() {
+        // Always keep the most recent tile, however small the budget
+        while (counters.resident_bytes > budget_bytes && lru.size() > 1) {
+            entries.erase(key(lru.back().cell));
+            lru.pop_back();
+            counters.resident_bytes -= tileBytes();
+            counters.evictions++;
+        }
+        counters.resident_tiles = lru.size();
+    }
+
+  public:
+    HeightTileCache(unsigned int _tile_w, unsigned int _tile_h,
+                    size_t _budget_bytes,
+                    void (*_generator)(glm::ivec2 cell, unsigned int w,
+                                       unsigned int h, float *heights,
+                                       float *slopes),
+                    TileArchive *_archive = nullptr) {
+        tile_w = _tile_w;
+        tile_h = _tile_h;
+        budget_bytes = _budget_bytes;
+        generator = _generator;
+        archive = _archive;
+    }
+
+    // Floats in a tile: heights, then slopes
+    size_t tileFloats() { return (size_t)tile_w * tile_h * 3; }
+
+    // Resident cost of one tile, including bookkeeping
+    size_t tileBytes() {
+        return tileFloats() * sizeof(float) + sizeof(Entry) +
+               4 * sizeof(void *);
+    }
+
+    // Returns the heights and slopes of cell, generating them on a miss
+    Tile get(glm::ivec2 cell) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = entries.find(key(cell));
+            if (it != entries.end()) {
+                lru.splice(lru.begin(), lru, it->second);
+                counters.hits++;
+                return it->second->heights;
+            }
+            counters.misses++;
+        }
+
+        // Load or generate without holding the lock so other cells stay
+        // available
+        Tile heights;
+        bool is_archived = false;
+        const float *archived =
+            archive != nullptr ? archive->find(cell) : nullptr;
+        if (archived != nullptr) {
+            heights = Tile(Tile(), archived); // non-owning view of the map
+            is_archived = true;
+        } else {
+            float *generated = new float[tileFloats()];
+            generator(cell, tile_w, tile_h, generated,
+                      generated + tile_w * tile_h);
+            archived = archive != nullptr ? archive->store(cell, generated)
+                                          : nullptr;
+            if (archived != nullptr) {
+                delete[] generated;
+                heights = Tile(Tile(), archived);
+            } else {
+                heights = Tile(generated, std::default_delete<float[]>());
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (is_archived) {
+            counters.archive_hits++;
+        }
+        auto it = entries.find(key(cell));
+        if (it != entries.end()) {
+            // Another thread generated it meanwhile
+            lru.splice(lru.begin(), lru, it->second);
+            return it->second->heights;
+        }
+        Entry e;
+        e.cell = cell;
+        e.heights = heights;
+        lru.push_front(e);
+        entries[key(cell)] = lru.begin();
+        counters.resident_bytes += tileBytes();
+        evictOverBudget();
+        return heights;
+    }
+
+    // Height of the world vertex (x, z)
+    float heightAt(int x, int z) {
+        int span_x = tile_w - 1;
+        int span_z = tile_h - 1;
+        glm::ivec2 cell(floorDiv(x, span_x), floorDiv(z, span_z));
+        int c = x - cell.x * span_x;
+        int r = z - cell.y * span_z;
+        Tile tile = get(cell);
+        return tile.get()[r * tile_w + c];
+    }
+
+    bool contains(glm::ivec2 cell) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries.find(key(cell)) != entries.end();
+    }
+
+    void setBudget(size_t _budget_bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        budget_bytes = _budget_bytes;
+        evictOverBudget();
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        lru.clear();
+        entries.clear();
+        counters.resident_bytes = 0;
+        counters.resident_tiles = 0;
+    }
+
+    HeightCacheStats stats() {
+        std::lock_guard<std::mutex> lock(mutex);
+        HeightCacheStats s = counters;
+        s.budget_bytes = budget_bytes;
+        return s;
+    }
+};
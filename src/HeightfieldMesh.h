@@ -0,0 +1,252 @@
+#pragma once
+
+#include <algorithm>
+
+#include <Mesh.h>
+
+/*
+    GPU storage shared by a fixed number of heightfield tiles.
+
+    Slot i holds the w x h heights (R32F) and (dh/dx, dh/dz) slopes (RG32F)
+    of one tile starting at vertex i * w * h. Both are exposed to the vertex
+    shader as buffer textures, so any tile can be drawn by vertex offset and
+    all of them fit in one instanced draw.
+*/
+class HeightfieldPool {
+  private:
+    GLuint buffers[2] = {0, 0};  // heights, slopes
+    GLuint textures[2] = {0, 0}; // buffer textures over them
+    unsigned int tile_vertices = 0;
+    unsigned int capacity = 0;
+
+  public:
+    bool isInit() { return capacity > 0; }
+
+    void init(unsigned int w, unsigned int h, unsigned int _capacity) {
+        tile_vertices = w * h;
+        capacity = _capacity;
+        const GLenum formats[2] = {GL_R32F, GL_RG32F};
+        const size_t channels[2] = {1, 2};
+        glGenBuffers(2, buffers);
+        glGenTextures(2, textures);
+        for (int i = 0; i < 2; i++) {
+            glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+            glBufferData(GL_TEXTURE_BUFFER,
+                         (size_t)capacity * tile_vertices * channels[i] *
+                             sizeof(float),
+                         nullptr, GL_DYNAMIC_DRAW);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+        }
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    int vertexOffset(unsigned int slot) { return slot * tile_vertices; }
+
+    void upload(unsigned int slot, const vector<float> &heights,
+                const vector<float> &slopes) {
+        size_t offset = (size_t)slot * tile_vertices * sizeof(float);
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers[0]);
+        glBufferSubData(GL_TEXTURE_BUFFER, offset,
+                        heights.size() * sizeof(float), &heights[0]);
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers[1]);
+        glBufferSubData(GL_TEXTURE_BUFFER, offset * 2,
+                        slopes.size() * sizeof(float), &slopes[0]);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // Binds heights and slopes to texture units unit and unit + 1
+    void bind(Program &program, int unit) {
+        const char *names[2] = {"terrainHeights", "terrainSlopes"};
+        for (int i = 0; i < 2; i++) {
+            glActiveTexture(GL_TEXTURE0 + unit + i);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+            glUniform1i(program.uniform(names[i]), unit + i);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    void free() {
+        glDeleteTextures(2, textures);
+        glDeleteBuffers(2, buffers);
+        textures[0] = textures[1] = 0;
+        buffers[0] = buffers[1] = 0;
+        capacity = 0;
+    }
+};
+
+/*
+    A terrain tile on a regular grid that keeps only what can't be derived.
+
+    Vertices sit one world unit apart, so positions follow from (col, row)
+    plus the height, and every tile shares the same triangle topology
+    (gridIndices()). Resident CPU state is one height and one (dh/dx, dh/dz)
+    slope per vertex, and those two streams are also all that is uploaded,
+    into the tile's slot of a HeightfieldPool: the vertex shader fetches them
+    by vertex offset, rebuilds x/z from gl_VertexID and the normal from the
+    slope. The tile has no vertex attributes of its own. None of the general
+    Mesh containers (vertices, faces, adjacency map, flattened GL arrays) are
+    kept.
+
+    build() touches no GL state and can run on a worker thread.
+    uploadBuffers() must run on the GL thread.
+*/
+class HeightfieldMesh : public Mesh {
+  private:
+    // fills a whole w x h heightfield starting at a world vertex offset
+    void (*height_tile_callback)(glm::ivec2 grid_origin, unsigned int w,
+                                 unsigned int h, float *out);
+    // fills the slope of every vertex in world units, as interleaved
+    // (dh/dx, dh/dz) pairs
+    void (*slope_tile_callback)(glm::ivec2 grid_origin, unsigned int w,
+                                unsigned int h, float *slopes);
+    HeightfieldPool *pool;
+    unsigned int slot;
+
+  public:
+    HeightfieldMesh(int _id, unsigned int _width, unsigned int _height,
+                    void (*_height_tile_callback)(glm::ivec2 grid_origin,
+                                                  unsigned int w,
+                                                  unsigned int h, float *out),
+                    void (*_slope_tile_callback)(glm::ivec2 grid_origin,
+                                                 unsigned int w,
+                                                 unsigned int h,
+                                                 float *slopes),
+                    glm::ivec2 _grid_origin, HeightfieldPool *_pool,
+                    unsigned int _slot) {
+        id = _id;
+        width = _width;
+        height = _height;
+        height_tile_callback = _height_tile_callback;
+        slope_tile_callback = _slope_tile_callback;
+        grid_origin = _grid_origin;
+        pool = _pool;
+        slot = _slot;
+        num_indices = (width - 1) * (height - 1) * 6;
+    }
+
+    vector<float> heights;    // width x height, row-major
+    vector<float> slopes;     // (dh/dx, dh/dz) per vertex
+    vector<float> lod_errors; // max height error of each LOD level
+
+    // LOD level L keeps every 2^L-th row and column plus the last one
+    static int lodLevels(unsigned int w, unsigned int h) {
+        int levels = 1;
+        while ((1u << levels) < std::min(w, h) - 1) {
+            levels++;
+        }
+        return levels;
+    }
+
+    // Triangle list shared by every w x h tile (same winding as Mesh)
+    static vector<unsigned int> gridIndices(unsigned int w, unsigned int h) {
+        vector<unsigned int> grid;
+        grid.reserve((w - 1) * (h - 1) * 6);
+        for (unsigned int r = 0; r < h - 1; r++) {
+            for (unsigned int c = 0; c < w - 1; c++) {
+                // Upper triangle
+                grid.push_back(r * w + c);
+                grid.push_back((r + 1) * w + c);
+                grid.push_back(r * w + c + 1);
+                // Lower triangle
+                grid.push_back((r + 1) * w + c);
+                grid.push_back((r + 1) * w + c + 1);
+                grid.push_back(r * w + c + 1);
+            }
+        }
+        return grid;
+    }
+
+    glm::vec3 position(unsigned int c, unsigned int r) {
+        return glm::vec3(c, heights[r * width + c], r);
+    }
+
+    glm::vec3 normal(unsigned int c, unsigned int r) {
+        unsigned int i = r * width + c;
+        return glm::normalize(
+            glm::vec3(-slopes[i * 2], 1.0f, -slopes[i * 2 + 1]));
+    }
+
+    // Resident CPU memory of the tile's geometry
+    size_t cpuBytes() {
+        return (heights.capacity() + slopes.capacity()) * sizeof(float);
+    }
+
+    // GPU memory of the tile's vertex streams
+    size_t gpuBytes() {
+        return (heights.size() + slopes.size()) * sizeof(float);
+    }
+
+    // Height of vertex (c, r) as drawn by the grid that keeps every step-th
+    // row and column. Mirrors coarseHeight() in vertex_shader.glsl.
+    float lodHeight(unsigned int c, unsigned int r, unsigned int step) {
+        unsigned int c0 = c / step * step;
+        unsigned int r0 = r / step * step;
+        unsigned int c1 = std::min(c0 + step, width - 1);
+        unsigned int r1 = std::min(r0 + step, height - 1);
+        float u = c1 > c0 ? (float)(c - c0) / (c1 - c0) : 0.0f;
+        float v = r1 > r0 ? (float)(r - r0) / (r1 - r0) : 0.0f;
+        float h00 = heights[r0 * width + c0];
+        float h01 = heights[r0 * width + c1];
+        float h10 = heights[r1 * width + c0];
+        float h11 = heights[r1 * width + c1];
+        // Same diagonal as gridIndices()
+        if (u + v <= 1.0f) {
+            return h00 + u * (h01 - h00) + v * (h10 - h00);
+        }
+        return h11 + (1.0f - u) * (h10 - h11) + (1.0f - v) * (h01 - h11);
+    }
+
+    // First vertex of the tile in the pool, for the vertex shader
+    int vertexOffset() { return pool->vertexOffset(slot); }
+
+    // Samples heights and slopes for grid_origin, replacing the old ones
+    void build() {
+        unsigned int n = width * height;
+        heights.resize(n);
+        slopes.resize(n * 2);
+        height_tile_callback(grid_origin, width, height, &heights[0]);
+        slope_tile_callback(grid_origin, width, height, &slopes[0]);
+
+        // Bounding sphere
+        float h_sum = 0.0f;
+        for (float h : heights) {
+            h_sum += h;
+        }
+        center = glm::vec3((width - 1) * 0.5f, h_sum / n, (height - 1) * 0.5f);
+        float max_dist = 0.0f;
+        for (unsigned int r = 0; r < height; r++) {
+            for (unsigned int c = 0; c < width; c++) {
+                max_dist = glm::max(max_dist,
+                                    glm::distance(center, position(c, r)));
+            }
+        }
+        mesh_radius = max_dist;
+
+        // Geometric error of each LOD level, never smaller than the finer
+        // level's so coarser levels are only picked further away
+        int levels = lodLevels(width, height);
+        lod_errors.assign(levels, 0.0f);
+        for (int l = 1; l < levels; l++) {
+            float max_err = lod_errors[l - 1];
+            for (unsigned int r = 0; r < height; r++) {
+                for (unsigned int c = 0; c < width; c++) {
+                    float err = heights[r * width + c] -
+                                lodHeight(c, r, 1 << l);
+                    max_err = glm::max(max_err, glm::abs(err));
+                }
+            }
+            lod_errors[l] = max_err;
+        }
+        has_loaded = true;
+    }
+
+    // Uploads the height and slope streams into the tile's pool slot
+    void uploadBuffers() {
+        pool->upload(slot, heights, slopes);
+        if (VAO.id == 0) {
+            VAO.init(); // empty, but core profile draws need one bound
+        }
+    }
+};
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <DrawStats.h>
+#include <Mesh.h>
+
+// Per-instance values, laid out as they sit in the instance buffer
+struct InstanceData {
+    glm::mat4 model_matrix; // mirror is already folded in (see updateModel)
+    glm::vec3 color;
+    int vertex_offset; // first vertex of the instance in a shared pool
+    int lod_step;      // terrain LOD grid step, 1 for plain meshes
+    float lod_morph;   // terrain LOD morph towards 2 * lod_step
+};
+
+/*
+    Draws many copies of one index buffer with a single
+    glDrawElementsInstanced call.
+
+    The model matrix, color and vertex offset of every copy go to the GPU in
+    one instance buffer, read by the vertex shader through the
+    instance_ModelMatrix, instance_color, instance_vertexOffset,
+    instance_lodStep and instance_lodMorph attributes (advanced once per
+    instance). Per-vertex attributes of a shared mesh can be recorded in the
+    same VAO; terrain tiles need none since they fetch their heights by
+    vertex offset.
+
+    Usage, every frame: clear(), add() each visible copy, draw().
+*/
+class InstanceBatch {
+  private:
+    vector<InstanceData> instances;
+    GLuint instance_buffer = 0;
+    size_t buffer_capacity = 0; // instances the buffer has room for
+
+  public:
+    VertexArrayObject VAO;
+
+    // Records the instance attributes, plus the vertex attributes of mesh
+    // when given, in the batch's VAO
+    void init(Program &program, Mesh *mesh = nullptr) {
+        VAO.init();
+        VAO.bind();
+        if (mesh != nullptr) {
+            mesh->bindAttributeArrays(program);
+        }
+
+        glGenBuffers(1, &instance_buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+        GLsizei stride = sizeof(InstanceData);
+
+        // A mat4 attribute takes 4 consecutive vec4 locations
+        GLint model = program.attrib("instance_ModelMatrix");
+        if (model >= 0) {
+            for (int i = 0; i < 4; i++) {
+                glEnableVertexAttribArray(model + i);
+                glVertexAttribPointer(
+                    model + i, 4, GL_FLOAT, GL_FALSE, stride,
+                    (void *)(offsetof(InstanceData, model_matrix) +
+                             i * sizeof(glm::vec4)));
+                glVertexAttribDivisor(model + i, 1);
+            }
+        }
+        GLint color = program.attrib("instance_color");
+        if (color >= 0) {
+            glEnableVertexAttribArray(color);
+            glVertexAttribPointer(color, 3, GL_FLOAT, GL_FALSE, stride,
+                                  (void *)offsetof(InstanceData, color));
+            glVertexAttribDivisor(color, 1);
+        }
+        GLint offset = program.attrib("instance_vertexOffset");
+        if (offset >= 0) {
+            glEnableVertexAttribArray(offset);
+            glVertexAttribIPointer(
+                offset, 1, GL_INT, stride,
+                (void *)offsetof(InstanceData, vertex_offset));
+            glVertexAttribDivisor(offset, 1);
+        }
+        GLint lod_step = program.attrib("instance_lodStep");
+        if (lod_step >= 0) {
+            glEnableVertexAttribArray(lod_step);
+            glVertexAttribIPointer(lod_step, 1, GL_INT, stride,
+                                   (void *)offsetof(InstanceData, lod_step));
+            glVertexAttribDivisor(lod_step, 1);
+        }
+        GLint lod_morph = program.attrib("instance_lodMorph");
+        if (lod_morph >= 0) {
+            glEnableVertexAttribArray(lod_morph);
+            glVertexAttribPointer(lod_morph, 1, GL_FLOAT, GL_FALSE, stride,
+                                  (void *)offsetof(InstanceData, lod_morph));
+            glVertexAttribDivisor(lod_morph, 1);
+        }
+    }
+
+    void clear() { instances.clear(); }
+
+    void add(const glm::mat4 &model_matrix, glm::vec3 color,
+             int vertex_offset = 0, int lod_step = 1, float lod_morph = 0.0f) {
+        InstanceData d;
+        d.model_matrix = model_matrix;
+        d.color = color;
+        d.vertex_offset = vertex_offset;
+        d.lod_step = lod_step;
+        d.lod_morph = lod_morph;
+        instances.push_back(d);
+    }
+
+    size_t size() { return instances.size(); }
+
+    // Uploads the instances and draws num_indices indices of index_buffer,
+    // starting at first_index, once per instance
+    void draw(IndexBufferObject &index_buffer, unsigned int num_indices,
+              size_t first_index = 0, DrawStats *stats = nullptr) {
+        if (instances.empty()) {
+            return;
+        }
+        VAO.bind();
+
+        // Orphan the old contents so the driver needn't wait on last frame
+        glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+        size_t bytes = instances.size() * sizeof(InstanceData);
+        if (instances.size() > buffer_capacity) {
+            buffer_capacity = instances.size();
+        }
+        glBufferData(GL_ARRAY_BUFFER, buffer_capacity * sizeof(InstanceData),
+                     nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, &instances[0]);
+
+        index_buffer.bind();
+        glDrawElementsInstanced(GL_TRIANGLES, num_indices, index_buffer.type,
+                                index_buffer.offset(first_index),
+                                (GLsizei)instances.size());
+        if (stats != nullptr) {
+            stats->add(num_indices, instances.size());
+        }
+    }
+
+    void free() {
+        if (instance_buffer != 0) {
+            glDeleteBuffers(1, &instance_buffer);
+            instance_buffer = 0;
+        }
+        VAO.free();
+    }
+};
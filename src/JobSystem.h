@@ -0,0 +1,223 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <Profiler.h>
+
+// Shared state of a submitted job. Continuations attached with
+// JobSystem::then() are scheduled as soon as the job finishes.
+struct JobState {
+    std::function<void()> fn;
+    std::mutex mutex;
+    std::condition_variable done_cv;
+    bool done = false;
+    std::vector<std::shared_ptr<JobState>> continuations;
+};
+
+typedef std::shared_ptr<JobState> JobHandle;
+
+/*
+    A persistent pool of worker threads with per-worker deques.
+
+    Workers pop their own newest jobs first (LIFO keeps caches warm) and
+    steal the oldest jobs from other workers when they run dry. Jobs
+    submitted from outside the pool (e.g. the render thread) are spread
+    round-robin across the worker queues. Threads are created once, so
+    submitting a job never pays for thread creation.
+*/
+class JobSystem {
+  private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<JobHandle> jobs;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_cv;
+    std::atomic<int> pending_jobs;
+    std::atomic<unsigned int> next_queue;
+    std::atomic<bool> is_running;
+
+    // Index of the worker running on this thread, -1 for outside threads
+    static int &workerIndex() {
+        static thread_local int index = -1;
+        return index;
+    }
+
+    void push(const JobHandle &job) {
+        int self = workerIndex();
+        unsigned int q = self >= 0 ? (unsigned int)self
+                                   : next_queue.fetch_add(1) % queues.size();
+        {
+            std::lock_guard<std::mutex> lock(queues[q]->mutex);
+            queues[q]->jobs.push_back(job);
+        }
+        pending_jobs.fetch_add(1);
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        sleep_cv.notify_one();
+    }
+
+    // Own queue from the back, then steal from the front of the others
+    JobHandle pop(int self) {
+        unsigned int n = queues.size();
+        if (self >= 0) {
+            WorkerQueue &own = *queues[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.jobs.empty()) {
+                JobHandle job = own.jobs.back();
+                own.jobs.pop_back();
+                pending_jobs.fetch_sub(1);
+                return job;
+            }
+        }
+        unsigned int start = self >= 0 ? self + 1 : next_queue.load();
+        for (unsigned int i = 0; i < n; i++) {
+            WorkerQueue &victim = *queues[(start + i) % n];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.jobs.empty()) {
+                JobHandle job = victim.jobs.front();
+                victim.jobs.pop_front();
+                pending_jobs.fetch_sub(1);
+                return job;
+            }
+        }
+        return nullptr;
+    }
+
+    void run(const JobHandle &job) {
+        if (job->fn) {
+            ProfileZone zone("job");
+            job->fn();
+        }
+        std::vector<JobHandle> continuations;
+        {
+            std::lock_guard<std::mutex> lock(job->mutex);
+            job->done = true;
+            job->fn = nullptr; // release captured state
+            continuations.swap(job->continuations);
+        }
+        job->done_cv.notify_all();
+        for (JobHandle &c : continuations) {
+            push(c);
+        }
+    }
+
+    void workerLoop(int index) {
+        workerIndex() = index;
+        Profiler::setThreadName("worker " + std::to_string(index));
+        while (is_running) {
+            JobHandle job = pop(index);
+            if (job) {
+                run(job);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            sleep_cv.wait(lock, [this] {
+                return !is_running || pending_jobs.load() > 0;
+            });
+        }
+    }
+
+  public:
+    // num_workers = 0 uses one worker per hardware thread, minus the caller
+    JobSystem(unsigned int num_workers = 0)
+        : pending_jobs(0), next_queue(0), is_running(true) {
+        if (num_workers == 0) {
+            unsigned int hw = std::thread::hardware_concurrency();
+            num_workers = hw > 1 ? hw - 1 : 1;
+        }
+        for (unsigned int i = 0; i < num_workers; i++) {
+            queues.emplace_back(new WorkerQueue());
+        }
+        for (unsigned int i = 0; i < num_workers; i++) {
+            workers.emplace_back(&JobSystem::workerLoop, this, (int)i);
+        }
+    }
+
+    // Stops the workers. Jobs still queued at this point are dropped.
+    ~JobSystem() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            is_running = false;
+        }
+        sleep_cv.notify_all();
+        for (std::thread &t : workers) {
+            t.join();
+        }
+    }
+
+    unsigned int size() { return workers.size(); }
+
+    // Schedules fn on the pool, returns a handle to wait on or chain from
+    JobHandle submit(std::function<void()> fn) {
+        JobHandle job = std::make_shared<JobState>();
+        job->fn = std::move(fn);
+        push(job);
+        return job;
+    }
+
+    // Schedules fn to run once parent has finished
+    JobHandle then(const JobHandle &parent, std::function<void()> fn) {
+        JobHandle job = std::make_shared<JobState>();
+        job->fn = std::move(fn);
+        {
+            std::lock_guard<std::mutex> lock(parent->mutex);
+            if (!parent->done) {
+                parent->continuations.push_back(job);
+                return job;
+            }
+        }
+        push(job);
+        return job;
+    }
+
+    bool isDone(const JobHandle &job) {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        return job->done;
+    }
+
+    // Blocks until job is done. Helps run queued jobs meanwhile, so waiting
+    // from inside a job can't deadlock the pool.
+    void wait(const JobHandle &job) {
+        while (!isDone(job)) {
+            JobHandle other = pop(workerIndex());
+            if (other) {
+                run(other);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(job->mutex);
+            job->done_cv.wait_for(lock, std::chrono::milliseconds(1),
+                                  [&job] { return job->done; });
+        }
+    }
+
+    // Splits [begin, end) into chunks of `grain` and runs fn(chunk_begin,
+    // chunk_end) on the pool. The caller takes part and returns when every
+    // chunk has finished.
+    void parallelFor(unsigned int begin, unsigned int end, unsigned int grain,
+                     const std::function<void(unsigned int, unsigned int)> &fn) {
+        if (grain == 0) {
+            grain = 1;
+        }
+        std::vector<JobHandle> chunks;
+        for (unsigned int b = begin; b < end; b += grain) {
+            unsigned int e = std::min(end, b + grain);
+            chunks.push_back(submit([&fn, b, e] { fn(b, e); }));
+        }
+        for (JobHandle &c : chunks) {
+            wait(c);
+        }
+    }
+};
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+    Read-only view of a whole file.
+
+    The file is memory-mapped, so parsers walk it in place straight out of
+    the page cache with no read() copies or line buffers. Where mmap isn't
+    available the file is read into memory instead, behind the same API.
+*/
+class MappedFile {
+  private:
+    const char *bytes = nullptr;
+    size_t length = 0;
+    bool is_mapped = false;
+    std::vector<char> buffer; // fallback copy when not mapped
+
+  public:
+    MappedFile() {}
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const std::string &path) {
+        close();
+#ifndef _WIN32
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            return false;
+        }
+        length = (size_t)st.st_size;
+        if (length == 0) {
+            ::close(fd);
+            return true;
+        }
+        void *mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // the mapping keeps the file alive
+        if (mapping != MAP_FAILED) {
+            madvise(mapping, length, MADV_SEQUENTIAL);
+            bytes = (const char *)mapping;
+            is_mapped = true;
+            return true;
+        }
+#endif
+        FILE *file = fopen(path.c_str(), "rb");
+        if (file == nullptr) {
+            length = 0;
+            return false;
+        }
+        fseek(file, 0, SEEK_END);
+        long file_size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        buffer.resize(file_size > 0 ? (size_t)file_size : 0);
+        length = fread(buffer.data(), 1, buffer.size(), file);
+        fclose(file);
+        bytes = buffer.data();
+        return true;
+    }
+
+    void close() {
+#ifndef _WIN32
+        if (is_mapped) {
+            munmap((void *)bytes, length);
+        }
+#endif
+        bytes = nullptr;
+        length = 0;
+        is_mapped = false;
+        buffer.clear();
+    }
+
+    const char *begin() const { return bytes; }
+    const char *end() const { return bytes + length; }
+    size_t size() const { return length; }
+};
@@ -0,0 +1,511 @@
+// Mesh geometry that needs no GL context: heightfields, file parsing,
+// caches and picking. Part of the core library the tools link.
+
+#include <Mesh.h>
+
+#include <unordered_map>
+
+// Builds the CPU side of a w x h heightfield without touching GL. Existing
+// geometry is replaced.
+void Mesh::buildHeightfield(unsigned int w, unsigned int h) {
+    vertices.clear();
+    vertex_colors.clear();
+    faces.clear();
+    triangle_normals.clear();
+    vertex_normals.clear();
+    vertex_to_triangles_map.clear();
+
+    // Create vertices
+    vertices.reserve(w * h);
+    float spacing = 1.0;
+
+    // Elevations for the whole grid, one row per noise call when batched
+    vector<float> elevations(w * h);
+    vector<float> dx; // noise slopes, when the callback gives them
+    vector<float> dz;
+    if (noise_row_callback != nullptr || noise_row_d_callback != nullptr) {
+        vector<float> xs(w);
+        for (unsigned int c = 0; c < w; c++) {
+            xs[c] = (float)(grid_origin.x + (int)c) / w;
+        }
+        if (noise_row_d_callback != nullptr) {
+            dx.resize(w * h);
+            dz.resize(w * h);
+        }
+        auto fillRows = [&](unsigned int r_begin, unsigned int r_end) {
+            for (unsigned int r = r_begin; r < r_end; r++) {
+                float y = (float)(grid_origin.y + (int)r) / h;
+                if (noise_row_d_callback != nullptr) {
+                    noise_row_d_callback(&xs[0], y, w, &elevations[r * w],
+                                         &dx[r * w], &dz[r * w]);
+                } else {
+                    noise_row_callback(&xs[0], y, w, &elevations[r * w]);
+                }
+            }
+        };
+        if (job_system != nullptr) {
+            job_system->parallelFor(0, h, 8, fillRows);
+        } else {
+            fillRows(0, h);
+        }
+    } else {
+        for (int r = 0; r < h; r++) {
+            for (int c = 0; c < w; c++) {
+                // look up in elevation table
+                elevations[r * w + c] =
+                    noise_callback((float)(grid_origin.x + c) / w,
+                                   (float)(grid_origin.y + r) / h);
+            }
+        }
+    }
+
+    // Rows
+    for (int r = 0; r < h; r++) {
+        // Cols
+        for (int c = 0; c < w; c++) {
+            // NOTE: origin is not at center of mesh
+            float x = c; // col
+            float z = r; // row
+            float y = elevations[r * w + c];
+            glm::vec3 v(x * spacing, y * spacing, z); //
+            vertices.emplace_back(v);
+
+            // Vertex colors not supported!
+            vertex_colors.push_back(glm::vec3(0.0, 0.0, 0.0));
+
+            // Create a vector in the mapping
+            if (dx.empty()) {
+                vector<int> triangles;
+                vertex_to_triangles_map.emplace(vertices.size() - 1,
+                                                triangles);
+            }
+        }
+    }
+
+    // Generate faces
+
+    // Rows (-1 for last)
+    for (int r = 0; r < h - 1; r++) {
+        // Cols (-1 for last)
+        for (int c = 0; c < w - 1; c++) {
+            // Upper triangle
+            /*
+
+                v0 -- v2
+                |    /
+                |  /
+                v1
+            */
+            int f0_0 = (r * w) + c;
+            int f0_1 = ((r + 1) * w) + c;
+            int f0_2 = (r * w) + c + 1;
+            faces.emplace_back(f0_0, f0_1, f0_2);
+
+            // Lower triangle
+            /*
+
+                      v2
+                     / |
+                   /   |
+                v0 --- v1
+            */
+            int f1_0 = ((r + 1) * w) + c;
+            ;
+            int f1_1 = ((r + 1) * w) + c + 1;
+            int f1_2 = (r * w) + c + 1;
+
+            faces.emplace_back(f1_0, f1_1, f1_2);
+        }
+    }
+
+    if (dx.empty()) {
+        prepareVectors();
+        return;
+    }
+
+    // Normals straight from the noise slope: n = (-dh/dx, 1, -dh/dz), with
+    // the slopes scaled from noise space (x / w, y / h) to world units
+    computeBounds();
+    vertex_normals.reserve(w * h);
+    for (unsigned int i = 0; i < w * h; i++) {
+        vertex_normals.emplace_back(
+            glm::normalize(glm::vec3(-dx[i] / w, 1.0f, -dz[i] / h)));
+    }
+}
+
+// Bounding sphere and index count
+void Mesh::computeBounds() {
+    center = glm::vec3(0.0, 0.0, 0.0);
+    for (glm::vec3 vec : vertices) {
+        center = center + vec;
+    }
+    center = center * float(1.0 / vertices.size());
+
+    // Set number of indices
+    num_indices = faces.size() * 3; // assuming only triangle primitive faces
+
+    // Set radius
+    glm::vec3 max_vertex(0, 0, 0);
+    float max_dist = 0;
+    for (glm::vec3 vec : vertices) {
+        float d = glm::abs(glm::distance(center, vec));
+        if (d >= max_dist) {
+            max_vertex = vec;
+            max_dist = d;
+        }
+    }
+
+    mesh_radius = max_dist;
+
+    std::cout << "Mesh Radius: " << mesh_radius << std::endl;
+}
+
+void Mesh::prepareVectors() {
+    computeBounds();
+
+    // Compute triangle_normals
+    triangle_normals.reserve(faces.size());
+    for (int i = 0; i < faces.size(); i++) {
+
+        int v0i = faces[i][0];
+        int v1i = faces[i][1];
+        int v2i = faces[i][2];
+
+        // Link vertex to triangle
+        vertex_to_triangles_map.at(v0i).push_back(i);
+        vertex_to_triangles_map.at(v1i).push_back(i);
+        vertex_to_triangles_map.at(v2i).push_back(i);
+
+        glm::vec3 v0 = vertices[v0i];
+        glm::vec3 v1 = vertices[v1i];
+        glm::vec3 v2 = vertices[v2i];
+        glm::vec3 tn = glm::triangleNormal(v0, v1, v2);
+        triangle_normals.emplace_back(tn);
+    }
+
+    // Compute vertex normals, unless the file gave one per vertex
+    if (vertex_normals.size() == vertices.size()) {
+        return;
+    }
+    vertex_normals.clear();
+    vertex_normals.reserve(vertices.size());
+    for (int i = 0; i < vertices.size(); i++) {
+        const vector<int> &triangle_indices = vertex_to_triangles_map[i];
+        glm::vec3 v_sum = glm::vec3(0.0f);
+
+        for (int j : triangle_indices) {
+            v_sum = v_sum + triangle_normals[j];
+        }
+        v_sum = glm::normalize(v_sum);
+        vertex_normals.emplace_back(v_sum);
+    }
+}
+
+// Hash of an OBJ corner's (position, uv, normal) indices
+struct ObjCornerHash {
+    size_t operator()(const glm::ivec3 &corner) const {
+        uint64_t h = (uint32_t)corner.x;
+        h = h * 0x9E3779B97F4A7C15ull + (uint32_t)corner.y;
+        h = h * 0x9E3779B97F4A7C15ull + (uint32_t)corner.z;
+        return (size_t)(h ^ (h >> 32));
+    }
+};
+
+// Loads an OBJ file through ObjParser. Every distinct (position, uv, normal)
+// corner becomes a vertex of its own, so hard edges and uv seams keep their
+// normals and uvs. The file's normals are used only when every corner has
+// one; otherwise they are computed per position, across uv seams.
+bool Mesh::loadObjFile(const char *filename) {
+    ObjMesh obj;
+    if (!ObjParser::load(filename, obj, job_system)) {
+        printf("Impossible to open the file !\n");
+        return false;
+    }
+
+    bool has_all_normals = !obj.normals.empty();
+    for (const glm::ivec3 &n : obj.triangle_normals) {
+        has_all_normals = has_all_normals && n.x >= 0 && n.y >= 0 && n.z >= 0;
+    }
+
+    std::unordered_map<glm::ivec3, unsigned int, ObjCornerHash> corner_vertex;
+    corner_vertex.reserve(obj.positions.size());
+    vector<int> vertex_position; // position index of every vertex
+    vertex_position.reserve(obj.positions.size());
+    faces.reserve(obj.triangles.size());
+    for (size_t i = 0; i < obj.triangles.size(); i++) {
+        glm::uvec3 face;
+        for (int k = 0; k < 3; k++) {
+            glm::ivec3 corner(obj.triangles[i][k], obj.triangle_uvs[i][k],
+                              has_all_normals ? obj.triangle_normals[i][k]
+                                              : -1);
+            auto found = corner_vertex.emplace(
+                corner, (unsigned int)vertex_position.size());
+            if (found.second) {
+                vertex_position.push_back(corner.x);
+                vertices.push_back(obj.positions[corner.x]);
+                vertex_colors.push_back(obj.colors[corner.x]);
+                uvs.push_back(corner.y >= 0 ? obj.uvs[corner.y]
+                                            : glm::vec2(0.0f));
+                if (has_all_normals) {
+                    vertex_normals.push_back(obj.normals[corner.z]);
+                }
+            }
+            face[k] = found.first->second;
+        }
+        faces.push_back(face);
+    }
+    for (unsigned int i = 0; i < vertices.size(); i++) {
+        vertex_to_triangles_map.emplace_hint(vertex_to_triangles_map.end(), i,
+                                             vector<int>());
+    }
+
+    if (!has_all_normals) {
+        // Every vertex of a position shares the position's smooth normal
+        vector<glm::vec3> position_normals(obj.positions.size(),
+                                           glm::vec3(0.0f));
+        for (const glm::uvec3 &f : faces) {
+            glm::vec3 tn = glm::triangleNormal(vertices[f[0]], vertices[f[1]],
+                                               vertices[f[2]]);
+            for (int k = 0; k < 3; k++) {
+                position_normals[vertex_position[f[k]]] += tn;
+            }
+        }
+        for (int p : vertex_position) {
+            vertex_normals.push_back(position_normals[p]);
+        }
+    }
+    for (glm::vec3 &n : vertex_normals) {
+        float length = glm::length(n);
+        n = length > 0.0f ? n / length : glm::vec3(0.0f, 1.0f, 0.0f);
+    }
+    normals = std::move(obj.normals);
+
+    return true;
+}
+
+// Loads an ASCII or binary OFF file through OffParser
+bool Mesh::loadOffFile(string filename) {
+    OffMesh off;
+    if (!OffParser::load(filename, off)) {
+        cout << "ERROR: could not read OFF file " << filename << endl;
+        return false;
+    }
+
+    vertices = std::move(off.positions);
+    if (off.colors.size() == vertices.size()) {
+        vertex_colors = std::move(off.colors);
+    } else {
+        vertex_colors.assign(vertices.size(), glm::vec3(0.0, 0.0, 0.0));
+    }
+    if (off.normals.size() == vertices.size()) {
+        vertex_normals.clear();
+        for (const glm::vec3 &n : off.normals) {
+            float length = glm::length(n);
+            vertex_normals.push_back(length > 0.0f ? n / length
+                                                   : glm::vec3(0, 1, 0));
+        }
+    }
+    faces.reserve(off.triangles.size());
+    for (const glm::ivec3 &t : off.triangles) {
+        faces.push_back(glm::uvec3(t));
+    }
+    for (unsigned int i = 0; i < vertices.size(); i++) {
+        vertex_to_triangles_map.emplace_hint(vertex_to_triangles_map.end(), i,
+                                             vector<int>());
+    }
+    return true;
+}
+
+// Picks the parser from the file extension. Fills the CPU side only.
+bool Mesh::parseFile(const string &filename) {
+    std::string::size_type idx = filename.rfind('.');
+    std::string extension("");
+    if (idx != std::string::npos) {
+        extension = filename.substr(idx + 1);
+        file_ext = extension;
+    }
+
+    bool is_parsed = false;
+    if (extension == "off") {
+        is_parsed = loadOffFile(filename);
+    } else if (extension == "obj") {
+        is_parsed = loadObjFile(filename.c_str());
+    } else {
+        cout << "ERROR: Unsupported mesh extension: ." << extension << endl;
+        exit(1);
+    }
+    if (!is_parsed) {
+        return false;
+    }
+
+    // Triangle order has to settle before faces get indexed by position
+    if (should_optimize) {
+        optimizeFaces();
+    }
+    prepareVectors();
+    return true;
+}
+
+// Reorders faces for the post-transform vertex cache and less overdraw
+void Mesh::optimizeFaces() {
+    VertexCacheStats before = MeshOptimizer::analyze(faces, vertices.size());
+    vector<unsigned int> order = MeshOptimizer::optimize(faces, vertices);
+
+    vector<glm::uvec3> reordered(faces.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        reordered[i] = faces[order[i]];
+    }
+    faces.swap(reordered);
+
+    VertexCacheStats after = MeshOptimizer::analyze(faces, vertices.size());
+    std::cout << "Mesh: optimized " << faces.size() << " triangles, ACMR "
+              << before.acmr << " -> " << after.acmr << ", ATVR "
+              << before.atvr << " -> " << after.atvr << std::endl;
+}
+
+// Writes the packed vertices and the faces as filename's mesh cache
+bool Mesh::writeCacheFile(const string &filename) {
+    vector<unsigned char> packed;
+    packVertices(packed);
+
+    MeshCache::Header header;
+    memset(&header, 0, sizeof(header));
+    header.vertex_format = vertex_format;
+    header.vertex_stride = VertexFormat::stride(vertex_format);
+    header.vertex_count = (uint32_t)vertices.size();
+    header.index_count = (uint32_t)faces.size() * 3;
+    header.index_size = sizeof(uint32_t);
+    header.flags = should_optimize ? MeshCache::FLAG_OPTIMIZED : 0;
+    memcpy(header.center, glm::value_ptr(center), sizeof(header.center));
+    header.radius = mesh_radius;
+    memcpy(header.position_scale, glm::value_ptr(position_scale),
+           sizeof(header.position_scale));
+    memcpy(header.position_offset, glm::value_ptr(position_offset),
+           sizeof(header.position_offset));
+
+    // 16-bit indices when they can address every vertex
+    const void *index_data = faceIndices();
+    vector<uint16_t> shorts;
+    if (IndexBufferObject::fitsShort(vertices.size())) {
+        shorts.assign(faceIndices(), faceIndices() + header.index_count);
+        index_data = shorts.data();
+        header.index_size = sizeof(uint16_t);
+    }
+    return MeshCache::write(filename, header, packed.data(), index_data);
+}
+
+// Parses filename and writes its mesh cache without touching GL
+bool Mesh::convertToCache(const string &filename, JobSystem *jobs,
+                          int vertex_format, bool should_optimize) {
+    Mesh mesh;
+    mesh.id = 0;
+    mesh.job_system = jobs;
+    mesh.vertex_format = vertex_format;
+    mesh.should_optimize = should_optimize;
+    if (!mesh.parseFile(filename)) {
+        return false;
+    }
+    return mesh.writeCacheFile(filename);
+}
+
+// Interleaves vertices, normals and colors in vertex_format
+void Mesh::packVertices(vector<unsigned char> &packed) {
+    VertexFormat::pack(vertex_format, vertices.data(), vertex_normals.data(),
+                       vertex_colors.data(), vertices.size(), packed,
+                       position_scale, position_offset);
+}
+
+// Generates the world vertices list
+vector<glm::vec3> Mesh::GetWorldVertices(const glm::mat4 &modelMatrix,
+                                         const glm::mat4 &viewMatrix,
+                                         const glm::mat4 &projectionMatrix) {
+    vector<glm::vec3> result;
+    result.reserve(vertices.size());
+    std::cout << "ModelMatrix Local: " << glm::to_string(modelMatrix) << "\n";
+    // result.reserve(vertices.size());
+    for (int i = 0; i < vertices.size(); i++) {
+
+        // result.emplace_back(vertices[i]);
+        glm::vec3 vertex = vertices[i];
+        glm::vec4 v_world = modelMatrix * //
+                            glm::vec4(vertex.x, vertex.y, vertex.z, 1.0);
+        glm::vec3 v_world_small(v_world.x, v_world.y, v_world.z);
+        result.emplace_back(v_world_small);
+    }
+    return result;
+}
+
+glm::vec3 Mesh::GetWorldCenter(const glm::mat4 &modelMatrix) {
+    glm::vec4 h_coords =
+        modelMatrix * glm::vec4(center.x, center.y, center.z, 1.0);
+
+    return glm::vec3(h_coords.x, h_coords.y, h_coords.z);
+}
+
+bool Mesh::DoesHit(const glm::vec3 ray, const glm::vec3 orig,
+                   const glm::mat4 &modelMatrix, float scale_factor,
+                   glm::vec3 center) {
+    float t;
+    glm::vec3 dir = ray;
+
+    float t0, t1; // solutions for t if the ray intersects
+
+    // geometric solution
+    glm::vec3 L = center - orig;
+    float radius2 = pow(mesh_radius * scale_factor, 2); // squared radius
+
+    float tca = glm::dot(L, dir);
+    if (tca < 0)
+        return false;
+    float d2 = glm::dot(L, L) - tca * tca;
+    if (d2 > radius2)
+        return false;
+    float thc = sqrt(radius2 - d2);
+    t0 = tca - thc;
+    t1 = tca + thc;
+
+    if (t0 > t1)
+        std::swap(t0, t1);
+
+    if (t0 < 0) {
+        t0 = t1; // if t0 is negative, let's use t1 instead
+        if (t0 < 0)
+            return false; // both t0 and t1 are negative
+    }
+
+    t = t0;
+
+    return true;
+}
+
+// Flattens vertices, colors and normals into GL-ready arrays. faces need no
+// flattening, see faceIndices().
+void Mesh::flattenVectors() {
+    vertices_vec.clear();
+    vertex_colors_vec.clear();
+    vertex_normals_vec.clear();
+
+    for (glm::vec3 vert : vertices) {
+        vertices_vec.push_back(vert.x); // x
+        vertices_vec.push_back(vert.y); // y
+        vertices_vec.push_back(vert.z); // z
+    }
+
+    for (glm::vec3 vc : vertex_colors) {
+        vertex_colors_vec.push_back(vc.x); // x
+        vertex_colors_vec.push_back(vc.y); // y
+        vertex_colors_vec.push_back(vc.z); // z
+    }
+
+    for (glm::vec3 n : vertex_normals) {
+        vertex_normals_vec.push_back(n.x);
+        vertex_normals_vec.push_back(n.y);
+        vertex_normals_vec.push_back(n.z);
+    }
+}
+
+void Mesh::setAttributeKeyNames(int idx) {
+    vertex_key_name = "mesh_" + std::to_string(idx) + "_position";
+    vertex_color_key_name = "mesh_" + std::to_string(idx) + "_vertexColor";
+    vertex_normal_key_name = "mesh_" + std::to_string(idx) + "_vertexNormal";
+}
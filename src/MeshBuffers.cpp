@@ -0,0 +1,156 @@
+// Mesh buffer upload and attribute binding, which need a GL context
+
+#include <Mesh.h>
+
+void Mesh::generateVertexes(unsigned int w, unsigned int h) {
+    buildHeightfield(w, h);
+
+    setVectorsAndBuffers();
+
+    has_loaded = true;
+}
+
+void Mesh::loadFromFile(string filename) {
+    cout << ("Loading mesh from file: " + filename) << endl;
+
+    // A fresh binary cache skips parsing and normal generation entirely
+    if (!loadCacheFile(filename)) {
+        parseFile(filename);
+        uploadPackedBuffers();
+    }
+
+    has_loaded = true;
+}
+
+// Uploads the interleaved vertices and indices of filename's mesh cache
+// straight from the mapping. Returns false when there is no fresh cache.
+bool Mesh::loadCacheFile(const string &filename) {
+    MeshCache cache;
+    if (!cache.open(filename, vertex_format, should_optimize)) {
+        return false;
+    }
+    const MeshCache::Header &header = cache.header();
+    center = glm::make_vec3(header.center);
+    mesh_radius = header.radius;
+    num_indices = header.index_count;
+    vertex_stride = header.vertex_stride;
+    position_scale = glm::make_vec3(header.position_scale);
+    position_offset = glm::make_vec3(header.position_offset);
+
+    if (VBO.id == 0) {
+        VBO.init();
+    }
+    VBO.updateWithData(3, header.vertex_count, cache.vertexData(),
+                       cache.vertexBytes());
+    if (IBO.id == 0) {
+        IBO.init();
+    }
+    IBO.updateWithData(cache.indexData(), header.index_count,
+                       header.index_size);
+
+    std::cout << "Mesh: " << id << " from " << MeshCache::pathFor(filename)
+              << std::endl;
+    std::cout << "\tVertices: " << header.vertex_count << std::endl;
+    std::cout << "\tIndices: " << header.index_count << std::endl;
+    return true;
+}
+
+// Uploads the geometry of a parsed file as one interleaved VBO
+void Mesh::uploadPackedBuffers() {
+    vector<unsigned char> packed;
+    packVertices(packed);
+    vertex_stride = VertexFormat::stride(vertex_format);
+    if (VBO.id == 0) {
+        VBO.init();
+    }
+    VBO.updateWithData(3, vertices.size(), packed.data(), packed.size());
+
+    std::cout << "Mesh: " << id << std::endl;
+    std::cout << "\tVertices: " << vertices.size() << " ("
+              << VertexFormat::name(vertex_format) << ", " << vertex_stride
+              << " bytes each)" << std::endl;
+    std::cout << "\tIndices: " << faces.size() * 3 << std::endl;
+}
+
+void Mesh::setVectorsAndBuffers() {
+    flattenVectors();
+    uploadBuffers();
+
+    std::cout << "Mesh: " << id << std::endl;
+    std::cout << "\tVertexVector: " << vertices_vec.size() << std::endl;
+    std::cout << "\tVertexNormalsVector: " << vertex_normals_vec.size()
+              << std::endl;
+    std::cout << "\tIndices: " << faces.size() * 3 << std::endl;
+}
+
+// Sends the flattened arrays to the GPU. Buffers are created on first use
+// and re-filled in place afterwards, so recycled tiles keep their GL ids.
+void Mesh::uploadBuffers() {
+    // Initialize the VBO with the vertices data
+    // A VBO is a data container that lives in the GPU memory
+    if (VBO.id == 0) {
+        VBO.init();
+    }
+    VBO.updateWithVector(3, vertices_vec.size() / 3, vertices_vec);
+
+    if (VBO_C.id == 0) {
+        VBO_C.init();
+    }
+    VBO_C.updateWithVector(3, vertex_colors_vec.size() / 3, vertex_colors_vec);
+
+    // VBO for normals
+    if (VBO_VN.id == 0) {
+        VBO_VN.init();
+    }
+    VBO_VN.updateWithVector(3, vertex_normals_vec.size() / 3,
+                            vertex_normals_vec);
+}
+
+// Records this mesh's buffers in its own VAO. Buffers re-filled later by
+// uploadBuffers() keep their ids, so this only needs to run once.
+void Mesh::bindVertexAttributes(Program &program) {
+    if (VAO.id == 0) {
+        VAO.init();
+    }
+    VAO.bind();
+    bindAttributeArrays(program);
+}
+
+// Points the position, normal and color attributes at this mesh's buffers
+// in the currently bound VAO
+void Mesh::bindAttributeArrays(Program &program) {
+    // Meshes from files keep all three attributes in one interleaved buffer
+    if (vertex_stride > 0) {
+        bool is_float = vertex_format == VertexFormat::FLOAT;
+        GLenum position_type = is_float ? GL_FLOAT
+                               : vertex_format == VertexFormat::HALF
+                                   ? GL_HALF_FLOAT
+                                   : GL_UNSIGNED_SHORT;
+        GLenum normal_type = is_float ? GL_FLOAT : GL_INT_2_10_10_10_REV;
+        GLenum color_type = is_float ? GL_FLOAT : GL_UNSIGNED_BYTE;
+        VertexAttribute position = {
+            3, position_type, vertex_format == VertexFormat::QUANTIZED,
+            vertex_stride, 0};
+        VertexAttribute normal = {is_float ? 3 : 4, normal_type, !is_float,
+                                  vertex_stride,
+                                  VertexFormat::normalOffset(vertex_format)};
+        VertexAttribute color = {is_float ? 3 : 4, color_type, !is_float,
+                                 vertex_stride,
+                                 VertexFormat::colorOffset(vertex_format)};
+        program.bindVertexAttribArray(vertex_key_name, VBO, position);
+        program.bindVertexAttribArray(vertex_normal_key_name, VBO, normal);
+        program.bindVertexAttribArray(vertex_color_key_name, VBO, color);
+        return;
+    }
+
+    // The vertex shader wants the position of the vertices as an input.
+    // The following line connects the VBO we defined above with the
+    // position "slot" in the vertex shader
+    program.bindVertexAttribArray(vertex_key_name, VBO);
+
+    // Bind normals buffer
+    program.bindVertexAttribArray(vertex_normal_key_name, VBO_VN);
+
+    // Bind vertex colors buffer
+    program.bindVertexAttribArray(vertex_color_key_name, VBO_C);
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <sys/stat.h>
+
+#include <glm/glm.hpp>
+
+#include <MappedFile.h>
+#include <VertexFormat.h>
+
+/*
+    Binary mesh cache, written next to its source as "<source>.mesh".
+
+    The file is a fixed header followed by an interleaved vertex array (in
+    one of the VertexFormat layouts) and an index array of 16-bit (when the
+    vertex count allows) or 32-bit indices, both already in the layout the
+    GPU buffers use, so a loader maps it and hands the mapped pointers
+    straight to glBufferData with no parsing or copying. Arrays start on 16
+    byte boundaries.
+
+    The header records the size, modification time and 64-bit FNV-1a hash
+    of the source file it was built from. A source whose size and time
+    still match is taken as unchanged without reading it; only when the
+    time differs is it hashed. A cache whose source has changed since, that
+    holds another vertex format than the one asked for, whose triangles
+    were (or weren't) reordered by MeshOptimizer against what is asked for,
+    or that was written by another version or on a machine of the other
+    byte order, is ignored and the source is parsed instead.
+*/
+class MeshCache {
+  public:
+    static const uint32_t MAGIC = 0x434d5449; // "ITMC" read little-endian
+    static const uint32_t VERSION = 4; // 4: flags
+    static const uint32_t FLAG_OPTIMIZED = 1; // triangles reordered
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t source_hash;
+        uint64_t source_size;
+        uint64_t source_mtime; // nanoseconds since the epoch
+        uint32_t vertex_format; // VertexFormat layout
+        uint32_t vertex_stride; // bytes
+        uint32_t vertex_count;
+        uint32_t index_count;
+        uint32_t index_size; // bytes per index, 2 or 4
+        uint32_t flags;      // FLAG_*
+        uint64_t vertex_offset; // bytes from the start of the file
+        uint64_t index_offset;
+        float center[3];
+        float radius;
+        float position_scale[3]; // see VertexFormat::pack()
+        float position_offset[3];
+    };
+
+  private:
+    MappedFile file;
+    const Header *head = nullptr;
+
+    static uint64_t align(uint64_t offset) { return (offset + 15) & ~15ull; }
+
+  public:
+    static std::string pathFor(const std::string &source) {
+        return source + ".mesh";
+    }
+
+    static uint64_t hash(const char *bytes, size_t n) {
+        uint64_t h = 14695981039346656037ull;
+        for (size_t i = 0; i < n; i++) {
+            h = (h ^ (unsigned char)bytes[i]) * 1099511628211ull;
+        }
+        return h;
+    }
+
+    static bool hashFile(const std::string &path, uint64_t &hash_out) {
+        MappedFile source;
+        if (!source.open(path)) {
+            return false;
+        }
+        hash_out = hash(source.begin(), source.size());
+        return true;
+    }
+
+    // Size and modification time of path, without reading it
+    static bool statFile(const std::string &path, uint64_t &size_out,
+                         uint64_t &mtime_out) {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) {
+            return false;
+        }
+        size_out = (uint64_t)st.st_size;
+#if defined(__APPLE__)
+        mtime_out = (uint64_t)st.st_mtimespec.tv_sec * 1000000000ull +
+                    (uint64_t)st.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+        mtime_out = (uint64_t)st.st_mtime * 1000000000ull;
+#else
+        mtime_out = (uint64_t)st.st_mtim.tv_sec * 1000000000ull +
+                    (uint64_t)st.st_mtim.tv_nsec;
+#endif
+        return true;
+    }
+
+    // Whether source still has the contents the cache h was built from
+    static bool isSourceUnchanged(const std::string &source, const Header &h) {
+        uint64_t size, mtime, source_hash;
+        if (!statFile(source, size, mtime) || size != h.source_size) {
+            return false;
+        }
+        return mtime == h.source_mtime ||
+               (hashFile(source, source_hash) && source_hash == h.source_hash);
+    }
+
+    // Maps the cache of source if it exists, holds vertex_format, has its
+    // triangles optimized as is_optimized says and was built from the
+    // source's current contents
+    bool open(const std::string &source, int vertex_format,
+              bool is_optimized) {
+        close();
+        if (!file.open(pathFor(source))) {
+            return false;
+        }
+        if (file.size() < sizeof(Header)) {
+            close();
+            return false;
+        }
+        const Header *h = (const Header *)file.begin();
+        bool is_fresh =
+            h->magic == MAGIC && h->version == VERSION &&
+            h->vertex_format == (uint32_t)vertex_format &&
+            h->vertex_stride == VertexFormat::stride(vertex_format) &&
+            ((h->flags & FLAG_OPTIMIZED) != 0) == is_optimized &&
+            h->vertex_offset + (uint64_t)h->vertex_count * h->vertex_stride <=
+                file.size() &&
+            (h->index_size == 2 || h->index_size == 4) &&
+            h->index_offset + (uint64_t)h->index_count * h->index_size <=
+                file.size() &&
+            isSourceUnchanged(source, *h);
+        if (!is_fresh) {
+            std::cout << "MeshCache: " << pathFor(source)
+                      << " is stale, parsing " << source << std::endl;
+            close();
+            return false;
+        }
+        head = h;
+        return true;
+    }
+
+    void close() {
+        file.close();
+        head = nullptr;
+    }
+
+    const Header &header() const { return *head; }
+    const void *vertexData() const {
+        return file.begin() + head->vertex_offset;
+    }
+    size_t vertexBytes() const {
+        return (size_t)head->vertex_count * head->vertex_stride;
+    }
+    const void *indexData() const { return file.begin() + head->index_offset; }
+    size_t indexBytes() const {
+        return (size_t)head->index_count * head->index_size;
+    }
+
+    // Writes the cache of source. h gives the layout, counts and bounds; the
+    // rest of it is filled in here. The file is written under a temporary
+    // name and renamed into place, so readers never map a partial cache.
+    static bool write(const std::string &source, Header h,
+                      const void *vertices, const void *indices) {
+        h.magic = MAGIC;
+        h.version = VERSION;
+        if (!statFile(source, h.source_size, h.source_mtime) ||
+            !hashFile(source, h.source_hash)) {
+            return false;
+        }
+        h.vertex_offset = align(sizeof(Header));
+        h.index_offset = align(h.vertex_offset +
+                               (uint64_t)h.vertex_count * h.vertex_stride);
+
+        std::string path = pathFor(source);
+        std::string tmp_path = path + ".tmp";
+        FILE *out = fopen(tmp_path.c_str(), "wb");
+        if (out == nullptr) {
+            return false;
+        }
+        static const char ZEROS[16] = {0};
+        uint64_t vertex_end =
+            h.vertex_offset + (uint64_t)h.vertex_count * h.vertex_stride;
+        bool is_written =
+            fwrite(&h, sizeof(h), 1, out) == 1 &&
+            fwrite(ZEROS, 1, h.vertex_offset - sizeof(h), out) ==
+                h.vertex_offset - sizeof(h) &&
+            fwrite(vertices, h.vertex_stride, h.vertex_count, out) ==
+                h.vertex_count &&
+            fwrite(ZEROS, 1, h.index_offset - vertex_end, out) ==
+                h.index_offset - vertex_end &&
+            fwrite(indices, h.index_size, h.index_count, out) == h.index_count;
+        is_written = fclose(out) == 0 && is_written;
+        if (!is_written || rename(tmp_path.c_str(), path.c_str()) != 0) {
+            remove(tmp_path.c_str());
+            return false;
+        }
+        return true;
+    }
+};
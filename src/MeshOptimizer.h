@@ -0,0 +1,308 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Post-transform vertex cache efficiency of a triangle order
+struct VertexCacheStats {
+    float acmr; // transformed vertices per triangle, 0.5 at best, 3 at worst
+    float atvr; // transformed vertices per vertex used, 1 at best
+};
+
+/*
+    Reorders the triangles of an indexed mesh for the GPU.
+
+    optimizeVertexCache() is Tom Forsyth's "Linear-Speed Vertex Cache
+    Optimisation": triangles are emitted greedily by a score that favours
+    vertices recently used (still in a simulated LRU cache) and vertices
+    with few triangles left, so the post-transform cache hits more and the
+    vertex shader runs less often.
+
+    optimizeOverdraw() then follows Sander, Nehab and Barczak's "Fast
+    Triangle Reordering for Vertex Locality and Reduced Overdraw": the
+    cache-friendly order is cut into clusters wherever that costs little
+    cache efficiency, and clusters facing away from the mesh center are
+    drawn first, since they tend to occlude the rest.
+
+    Both return a permutation: entry i is the old index of the triangle
+    drawn i-th. Nothing here touches GL.
+*/
+class MeshOptimizer {
+  public:
+    static const int LRU_SIZE = 32;  // cache modelled by the Forsyth scores
+    static const int FIFO_SIZE = 16; // hardware cache modelled by analyze()
+
+  private:
+    // Forsyth's vertex score for a vertex at cache_position (-1 when not
+    // cached) with remaining triangles still to emit
+    static float vertexScore(int cache_position, unsigned int remaining) {
+        if (remaining == 0) {
+            return -1.0f;
+        }
+        float score = 0.0f;
+        if (cache_position >= 0) {
+            if (cache_position < 3) {
+                // The last triangle's vertices, scored lower so the order
+                // doesn't just strip along
+                score = 0.75f;
+            } else {
+                float x = 1.0f - (float)(cache_position - 3) / (LRU_SIZE - 3);
+                score = std::pow(x, 1.5f);
+            }
+        }
+        // Boost vertices with few triangles left, to finish them off
+        return score + 2.0f / std::sqrt((float)remaining);
+    }
+
+    // Simulated FIFO cache: a vertex is cached while fewer than FIFO_SIZE
+    // misses came after its own. clock counts misses.
+    struct Fifo {
+        std::vector<unsigned int> timestamps;
+        unsigned int clock;
+
+        Fifo(size_t num_vertices) : timestamps(num_vertices, 0) {
+            clock = FIFO_SIZE + 1;
+        }
+        void flush() { clock += FIFO_SIZE + 1; }
+        unsigned int misses(const glm::uvec3 &t) {
+            unsigned int before = clock;
+            for (int k = 0; k < 3; k++) {
+                if (clock - timestamps[t[k]] > FIFO_SIZE) {
+                    timestamps[t[k]] = clock++;
+                }
+            }
+            return clock - before;
+        }
+    };
+
+  public:
+    static VertexCacheStats analyze(const std::vector<glm::uvec3> &triangles,
+                                    size_t num_vertices) {
+        Fifo fifo(num_vertices);
+        unsigned int misses = 0;
+        for (const glm::uvec3 &t : triangles) {
+            misses += fifo.misses(t);
+        }
+        std::vector<bool> is_used(num_vertices, false);
+        size_t used = 0;
+        for (const glm::uvec3 &t : triangles) {
+            for (int k = 0; k < 3; k++) {
+                used += !is_used[t[k]];
+                is_used[t[k]] = true;
+            }
+        }
+        VertexCacheStats stats;
+        stats.acmr = triangles.empty() ? 0.0f : (float)misses / triangles.size();
+        stats.atvr = used == 0 ? 0.0f : (float)misses / used;
+        return stats;
+    }
+
+    static std::vector<unsigned int>
+    optimizeVertexCache(const std::vector<glm::uvec3> &triangles,
+                        size_t num_vertices) {
+        size_t num_triangles = triangles.size();
+        std::vector<unsigned int> order;
+        order.reserve(num_triangles);
+
+        // Triangles of every vertex, packed; remaining[v] of them unemitted
+        // sit at the front of the vertex's range
+        std::vector<unsigned int> remaining(num_vertices, 0);
+        for (const glm::uvec3 &t : triangles) {
+            for (int k = 0; k < 3; k++) {
+                remaining[t[k]]++;
+            }
+        }
+        std::vector<unsigned int> first(num_vertices + 1, 0);
+        for (size_t v = 0; v < num_vertices; v++) {
+            first[v + 1] = first[v] + remaining[v];
+        }
+        std::vector<unsigned int> adjacency(first[num_vertices]);
+        std::vector<unsigned int> filled(first.begin(), first.end() - 1);
+        for (size_t i = 0; i < num_triangles; i++) {
+            for (int k = 0; k < 3; k++) {
+                adjacency[filled[triangles[i][k]]++] = i;
+            }
+        }
+
+        std::vector<float> vertex_score(num_vertices);
+        for (size_t v = 0; v < num_vertices; v++) {
+            vertex_score[v] = vertexScore(-1, remaining[v]);
+        }
+        std::vector<bool> is_emitted(num_triangles, false);
+
+        std::vector<unsigned int> cache, next_cache;
+        size_t cursor = 0; // for restarts, no unemitted triangle before it
+        int best = -1;
+        while (order.size() < num_triangles) {
+            if (best < 0) {
+                // Dead end: nothing in the cache has triangles left
+                while (is_emitted[cursor]) {
+                    cursor++;
+                }
+                best = cursor;
+            }
+            const glm::uvec3 &t = triangles[best];
+            order.push_back(best);
+            is_emitted[best] = true;
+
+            // The triangle's vertices go to the front of the LRU cache
+            next_cache.assign(&t[0], &t[0] + 3);
+            for (unsigned int v : cache) {
+                if (v != t[0] && v != t[1] && v != t[2]) {
+                    next_cache.push_back(v);
+                }
+            }
+            for (int k = 0; k < 3; k++) {
+                unsigned int v = t[k];
+                unsigned int *tris = &adjacency[first[v]];
+                unsigned int *it =
+                    std::find(tris, tris + remaining[v], (unsigned int)best);
+                std::swap(*it, tris[remaining[v] - 1]);
+                remaining[v]--;
+            }
+
+            // Re-score the cached vertices (and the ones just pushed out),
+            // then their triangles, keeping the best for the next round
+            for (size_t i = 0; i < next_cache.size(); i++) {
+                unsigned int v = next_cache[i];
+                int position = i < LRU_SIZE ? (int)i : -1;
+                vertex_score[v] = vertexScore(position, remaining[v]);
+            }
+            float best_score = -1.0f;
+            best = -1;
+            for (unsigned int v : next_cache) {
+                for (unsigned int j = 0; j < remaining[v]; j++) {
+                    unsigned int tri = adjacency[first[v] + j];
+                    const glm::uvec3 &u = triangles[tri];
+                    float score = vertex_score[u[0]] + vertex_score[u[1]] +
+                                  vertex_score[u[2]];
+                    if (score > best_score) {
+                        best_score = score;
+                        best = tri;
+                    }
+                }
+            }
+            if (next_cache.size() > LRU_SIZE) {
+                next_cache.resize(LRU_SIZE);
+            }
+            cache.swap(next_cache);
+        }
+        return order;
+    }
+
+    // Reorders clusters of order (a vertex cache optimized order). A
+    // cluster may cost up to threshold times the ACMR of the run it is cut
+    // from.
+    static std::vector<unsigned int>
+    optimizeOverdraw(const std::vector<glm::uvec3> &triangles,
+                     const std::vector<glm::vec3> &positions,
+                     const std::vector<unsigned int> &order,
+                     float threshold = 1.05f) {
+        size_t n = order.size();
+        Fifo fifo(positions.size());
+
+        // Hard boundaries: triangles that miss on all 3 vertices, where the
+        // cache order restarted anyway
+        std::vector<size_t> hard;
+        for (size_t i = 0; i < n; i++) {
+            if (fifo.misses(triangles[order[i]]) == 3 || i == 0) {
+                hard.push_back(i);
+            }
+        }
+        hard.push_back(n);
+
+        // Soft boundaries: cut each run wherever the cluster so far is
+        // within threshold of the run's own ACMR
+        std::vector<size_t> clusters;
+        for (size_t h = 0; h + 1 < hard.size(); h++) {
+            size_t begin = hard[h], end = hard[h + 1];
+            unsigned int run_misses = 0;
+            fifo.flush();
+            for (size_t i = begin; i < end; i++) {
+                run_misses += fifo.misses(triangles[order[i]]);
+            }
+            float run_acmr = (float)run_misses / (end - begin);
+
+            size_t start = begin;
+            unsigned int misses = 0;
+            fifo.flush();
+            for (size_t i = begin; i < end; i++) {
+                misses += fifo.misses(triangles[order[i]]);
+                if ((float)misses / (i + 1 - start) <= run_acmr * threshold) {
+                    clusters.push_back(start);
+                    start = i + 1;
+                    misses = 0;
+                    fifo.flush(); // the next cluster starts cold
+                }
+            }
+            if (start < end) {
+                clusters.push_back(start);
+            }
+        }
+        clusters.push_back(n);
+
+        // Area-weighted centroid and normal of every cluster, and of the mesh
+        size_t num_clusters = clusters.size() - 1;
+        std::vector<glm::vec3> centroids(num_clusters, glm::vec3(0.0f));
+        std::vector<glm::vec3> normals(num_clusters, glm::vec3(0.0f));
+        std::vector<float> areas(num_clusters, 0.0f);
+        glm::vec3 mesh_centroid(0.0f);
+        float mesh_area = 0.0f;
+        for (size_t c = 0; c < num_clusters; c++) {
+            for (size_t i = clusters[c]; i < clusters[c + 1]; i++) {
+                const glm::uvec3 &t = triangles[order[i]];
+                glm::vec3 p0 = positions[t[0]];
+                glm::vec3 p1 = positions[t[1]];
+                glm::vec3 p2 = positions[t[2]];
+                glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+                float area = glm::length(normal);
+                glm::vec3 center = (p0 + p1 + p2) / 3.0f;
+                centroids[c] += center * area;
+                normals[c] += normal;
+                areas[c] += area;
+                mesh_centroid += center * area;
+                mesh_area += area;
+            }
+        }
+        if (mesh_area > 0.0f) {
+            mesh_centroid /= mesh_area;
+        }
+        std::vector<float> sort_keys(num_clusters);
+        for (size_t c = 0; c < num_clusters; c++) {
+            glm::vec3 centroid =
+                areas[c] > 0.0f ? centroids[c] / areas[c] : centroids[c];
+            float length = glm::length(normals[c]);
+            glm::vec3 normal = length > 0.0f ? normals[c] / length : normals[c];
+            sort_keys[c] = glm::dot(centroid - mesh_centroid, normal);
+        }
+
+        // Outward facing clusters first
+        std::vector<unsigned int> cluster_order(num_clusters);
+        for (size_t c = 0; c < num_clusters; c++) {
+            cluster_order[c] = c;
+        }
+        std::stable_sort(cluster_order.begin(), cluster_order.end(),
+                         [&](unsigned int a, unsigned int b) {
+                             return sort_keys[a] > sort_keys[b];
+                         });
+        std::vector<unsigned int> result;
+        result.reserve(n);
+        for (unsigned int c : cluster_order) {
+            result.insert(result.end(), order.begin() + clusters[c],
+                          order.begin() + clusters[c + 1]);
+        }
+        return result;
+    }
+
+    // Vertex cache order, then overdraw clusters
+    static std::vector<unsigned int>
+    optimize(const std::vector<glm::uvec3> &triangles,
+             const std::vector<glm::vec3> &positions) {
+        std::vector<unsigned int> order =
+            optimizeVertexCache(triangles, positions.size());
+        return optimizeOverdraw(triangles, positions, order);
+    }
+};
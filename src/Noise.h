@@ -0,0 +1,502 @@
+#pragma once
+
+#include <cmath>
+
+// SIMD lanes are picked at compile time. SSE2 is always present on x86-64;
+// AVX2 is used when the compiler is told it may (-mavx2 / USE_AVX2=ON).
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define NOISE_SIMD_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define NOISE_SIMD_SSE2 1
+#endif
+
+/*
+    Batched perlin / fBm noise.
+
+    The scalar kernel is an op-for-op port of glm::perlin(glm::vec2) so the
+    terrain looks exactly like it did before. The SIMD kernels run that same
+    sequence of float ops on 4 (SSE2) or 8 (AVX2) samples at once, so every
+    path returns bit-identical heights and can be mixed freely (e.g. the tail
+    of a row that doesn't fill a whole register goes through the scalar path).
+    That needs the compiler to leave a * b + c alone: the build passes
+    -ffp-contract=off, as must any other build of this header.
+
+    Inputs must stay well inside the int32 range (|x| < 2^31) since the SIMD
+    floor goes through an integer conversion.
+*/
+
+// Parameters for turning fBm noise into terrain elevations
+struct NoiseParams {
+    int octaves = 6;
+    float persistence = 8.0f;
+    float lateral_scaling = 0.1f;  // noise coords per normalized tile coord
+    float vertical_scaling = 10.0f; // elevation scale
+    float vertical_offset = 0.5f;
+    float min_elevation = 0.0f; // heights are clamped to this (water level)
+    unsigned int seed = 0;      // 0 keeps the original terrain
+};
+
+// Noise-space offset for a seed. Perlin repeats every 289 units, so the
+// offset is wrapped to keep precision. Seed 0 gives no offset.
+inline void seedOffset(unsigned int seed, float &ox, float &oy) {
+    ox = (float)std::fmod(seed * 0.7548776662466927, 289.0);
+    oy = (float)std::fmod(seed * 0.5698402909980532, 289.0);
+}
+
+namespace noise_detail {
+const float MOD289_INV = 1.0f / 289.0f;
+const float TAYLOR_A = 1.79284291400159f;
+const float TAYLOR_B = 0.85373472095314f;
+
+inline float mod289(float x) {
+    return x - std::floor(x * MOD289_INV) * 289.0f;
+}
+
+// glm::mod(x, 289) divides rather than multiplying by the reciprocal
+inline float mod289Div(float x) { return x - 289.0f * std::floor(x / 289.0f); }
+
+inline float permute(float x) { return mod289(((x * 34.0f) + 1.0f) * x); }
+
+inline float fade(float t) {
+    return (t * t * t) * (t * (t * 6.0f - 15.0f) + 10.0f);
+}
+
+inline float fadeDeriv(float t) {
+    return 30.0f * (t * t) * (t * (t - 2.0f) + 1.0f);
+}
+
+// Normalized gradient of the lattice corner with permuted index i
+inline void gradient(float i, float &gx, float &gy) {
+    gx = 2.0f * (i / 41.0f - std::floor(i / 41.0f)) - 1.0f;
+    gy = std::fabs(gx) - 0.5f;
+    float tx = std::floor(gx + 0.5f);
+    gx = gx - tx;
+    float norm = TAYLOR_A - TAYLOR_B * (gx * gx + gy * gy);
+    gx *= norm;
+    gy *= norm;
+}
+
+// Returns the normalized gradient dotted with the corner offset
+inline float corner(float i, float fx, float fy) {
+    float gx, gy;
+    gradient(i, gx, gy);
+    return gx * fx + gy * fy;
+}
+} // namespace noise_detail
+
+// Classic 2D perlin noise, bit-identical to glm::perlin(glm::vec2(x, y))
+inline float perlinNoise(float x, float y) {
+    using namespace noise_detail;
+    float x0 = std::floor(x);
+    float y0 = std::floor(y);
+    float fx0 = x - x0;
+    float fy0 = y - y0;
+    float fx1 = fx0 - 1.0f;
+    float fy1 = fy0 - 1.0f;
+    float ix0 = mod289Div(x0);
+    float iy0 = mod289Div(y0);
+    float ix1 = mod289Div(x0 + 1.0f);
+    float iy1 = mod289Div(y0 + 1.0f);
+
+    float n00 = corner(permute(permute(ix0) + iy0), fx0, fy0);
+    float n10 = corner(permute(permute(ix1) + iy0), fx1, fy0);
+    float n01 = corner(permute(permute(ix0) + iy1), fx0, fy1);
+    float n11 = corner(permute(permute(ix1) + iy1), fx1, fy1);
+
+    float u = fade(fx0);
+    float v = fade(fy0);
+    float nx0 = n00 * (1.0f - u) + n10 * u;
+    float nx1 = n01 * (1.0f - u) + n11 * u;
+    return 2.3f * (nx0 * (1.0f - v) + nx1 * v);
+}
+
+// perlinNoise() along with its partial derivatives. Each corner term is a
+// plane (gradient . offset), so the derivatives come from the same lattice
+// lookups as the value.
+inline float perlinNoiseD(float x, float y, float &dx, float &dy) {
+    using namespace noise_detail;
+    float x0 = std::floor(x);
+    float y0 = std::floor(y);
+    float fx0 = x - x0;
+    float fy0 = y - y0;
+    float fx1 = fx0 - 1.0f;
+    float fy1 = fy0 - 1.0f;
+    float ix0 = mod289Div(x0);
+    float iy0 = mod289Div(y0);
+    float ix1 = mod289Div(x0 + 1.0f);
+    float iy1 = mod289Div(y0 + 1.0f);
+
+    float g00x, g00y, g10x, g10y, g01x, g01y, g11x, g11y;
+    gradient(permute(permute(ix0) + iy0), g00x, g00y);
+    gradient(permute(permute(ix1) + iy0), g10x, g10y);
+    gradient(permute(permute(ix0) + iy1), g01x, g01y);
+    gradient(permute(permute(ix1) + iy1), g11x, g11y);
+    float n00 = g00x * fx0 + g00y * fy0;
+    float n10 = g10x * fx1 + g10y * fy0;
+    float n01 = g01x * fx0 + g01y * fy1;
+    float n11 = g11x * fx1 + g11y * fy1;
+
+    float u = fade(fx0);
+    float v = fade(fy0);
+    float du = fadeDeriv(fx0);
+    float dv = fadeDeriv(fy0);
+    float nx0 = n00 * (1.0f - u) + n10 * u;
+    float nx1 = n01 * (1.0f - u) + n11 * u;
+
+    float dnx0_dx = g00x * (1.0f - u) + g10x * u + (n10 - n00) * du;
+    float dnx1_dx = g01x * (1.0f - u) + g11x * u + (n11 - n01) * du;
+    float dnx0_dy = g00y * (1.0f - u) + g10y * u;
+    float dnx1_dy = g01y * (1.0f - u) + g11y * u;
+    dx = 2.3f * (dnx0_dx * (1.0f - v) + dnx1_dx * v);
+    dy = 2.3f * (dnx0_dy * (1.0f - v) + dnx1_dy * v + (nx1 - nx0) * dv);
+    return 2.3f * (nx0 * (1.0f - v) + nx1 * v);
+}
+
+// Fractal sum of perlin octaves, normalized by the total amplitude
+inline float fbmNoise(float x, float y, int octaves, float persistence) {
+    float total = 0.0f;
+    float frequency = 1.0f;
+    float amplitude = 1.0f;
+    float max_value = 0.0f;
+    for (int i = 0; i < octaves; i++) {
+        total += perlinNoise(x * frequency, y * frequency) * amplitude;
+        max_value += amplitude;
+        amplitude *= persistence;
+        frequency *= 2.0f;
+    }
+    return total / max_value;
+}
+
+// fbmNoise() along with its partial derivatives
+inline float fbmNoiseD(float x, float y, int octaves, float persistence,
+                       float &dx, float &dy) {
+    float total = 0.0f;
+    float frequency = 1.0f;
+    float amplitude = 1.0f;
+    float max_value = 0.0f;
+    dx = 0.0f;
+    dy = 0.0f;
+    for (int i = 0; i < octaves; i++) {
+        float ndx, ndy;
+        total += perlinNoiseD(x * frequency, y * frequency, ndx, ndy) *
+                 amplitude;
+        dx += ndx * (amplitude * frequency);
+        dy += ndy * (amplitude * frequency);
+        max_value += amplitude;
+        amplitude *= persistence;
+        frequency *= 2.0f;
+    }
+    dx /= max_value;
+    dy /= max_value;
+    return total / max_value;
+}
+
+// Maps normalized tile coords to a terrain elevation
+inline float terrainHeight(float x, float y, const NoiseParams &p) {
+    float ox, oy;
+    seedOffset(p.seed, ox, oy);
+    float val = fbmNoise(x * p.lateral_scaling + ox,
+                         y * p.lateral_scaling + oy, p.octaves,
+                         p.persistence) *
+                    p.vertical_scaling +
+                p.vertical_offset;
+    if (val < p.min_elevation) {
+        val = p.min_elevation;
+    }
+    return val;
+}
+
+// terrainHeight() along with its slope along the (normalized) x and y inputs.
+// The slope is zero where the height is clamped to min_elevation.
+inline float terrainHeightD(float x, float y, const NoiseParams &p,
+                            float &dx, float &dy) {
+    float ox, oy;
+    seedOffset(p.seed, ox, oy);
+    float val = fbmNoiseD(x * p.lateral_scaling + ox,
+                          y * p.lateral_scaling + oy, p.octaves,
+                          p.persistence, dx, dy) *
+                    p.vertical_scaling +
+                p.vertical_offset;
+    float slope_scale = p.lateral_scaling * p.vertical_scaling;
+    dx *= slope_scale;
+    dy *= slope_scale;
+    if (val < p.min_elevation) {
+        val = p.min_elevation;
+        dx = 0.0f;
+        dy = 0.0f;
+    }
+    return val;
+}
+
+namespace noise_detail {
+#if defined(NOISE_SIMD_AVX2)
+typedef __m256 vfloat;
+const int LANES = 8;
+inline vfloat vset(float f) { return _mm256_set1_ps(f); }
+inline vfloat vload(const float *p) { return _mm256_loadu_ps(p); }
+inline void vstore(float *p, vfloat v) { _mm256_storeu_ps(p, v); }
+inline vfloat vadd(vfloat a, vfloat b) { return _mm256_add_ps(a, b); }
+inline vfloat vsub(vfloat a, vfloat b) { return _mm256_sub_ps(a, b); }
+inline vfloat vmul(vfloat a, vfloat b) { return _mm256_mul_ps(a, b); }
+inline vfloat vdiv(vfloat a, vfloat b) { return _mm256_div_ps(a, b); }
+inline vfloat vmax(vfloat a, vfloat b) { return _mm256_max_ps(a, b); }
+inline vfloat vfloor(vfloat a) { return _mm256_floor_ps(a); }
+inline vfloat vabs(vfloat a) {
+    return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a);
+}
+// a where x >= lo, 0 elsewhere
+inline vfloat vzeroBelow(vfloat a, vfloat x, vfloat lo) {
+    return _mm256_andnot_ps(_mm256_cmp_ps(x, lo, _CMP_LT_OQ), a);
+}
+#elif defined(NOISE_SIMD_SSE2)
+typedef __m128 vfloat;
+const int LANES = 4;
+inline vfloat vset(float f) { return _mm_set1_ps(f); }
+inline vfloat vload(const float *p) { return _mm_loadu_ps(p); }
+inline void vstore(float *p, vfloat v) { _mm_storeu_ps(p, v); }
+inline vfloat vadd(vfloat a, vfloat b) { return _mm_add_ps(a, b); }
+inline vfloat vsub(vfloat a, vfloat b) { return _mm_sub_ps(a, b); }
+inline vfloat vmul(vfloat a, vfloat b) { return _mm_mul_ps(a, b); }
+inline vfloat vdiv(vfloat a, vfloat b) { return _mm_div_ps(a, b); }
+inline vfloat vmax(vfloat a, vfloat b) { return _mm_max_ps(a, b); }
+// SSE2 has no floor: truncate, then step down where truncation rounded up
+inline vfloat vfloor(vfloat a) {
+    vfloat t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a), _mm_set1_ps(1.0f)));
+}
+inline vfloat vabs(vfloat a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+inline vfloat vzeroBelow(vfloat a, vfloat x, vfloat lo) {
+    return _mm_andnot_ps(_mm_cmplt_ps(x, lo), a);
+}
+#endif
+
+#if defined(NOISE_SIMD_AVX2) || defined(NOISE_SIMD_SSE2)
+#define NOISE_SIMD 1
+inline vfloat vmod289(vfloat x) {
+    return vsub(x, vmul(vfloor(vmul(x, vset(MOD289_INV))), vset(289.0f)));
+}
+
+inline vfloat vmod289Div(vfloat x) {
+    vfloat m = vset(289.0f);
+    return vsub(x, vmul(m, vfloor(vdiv(x, m))));
+}
+
+inline vfloat vpermute(vfloat x) {
+    return vmod289(vmul(vadd(vmul(x, vset(34.0f)), vset(1.0f)), x));
+}
+
+inline vfloat vfade(vfloat t) {
+    vfloat t3 = vmul(vmul(t, t), t);
+    vfloat inner = vadd(
+        vmul(t, vsub(vmul(t, vset(6.0f)), vset(15.0f))), vset(10.0f));
+    return vmul(t3, inner);
+}
+
+inline vfloat vfadeDeriv(vfloat t) {
+    vfloat inner = vadd(vmul(t, vsub(t, vset(2.0f))), vset(1.0f));
+    return vmul(vmul(vset(30.0f), vmul(t, t)), inner);
+}
+
+inline void vgradient(vfloat i, vfloat &gx, vfloat &gy) {
+    vfloat q = vdiv(i, vset(41.0f));
+    gx = vsub(vmul(vset(2.0f), vsub(q, vfloor(q))), vset(1.0f));
+    gy = vsub(vabs(gx), vset(0.5f));
+    vfloat tx = vfloor(vadd(gx, vset(0.5f)));
+    gx = vsub(gx, tx);
+    vfloat norm = vsub(vset(TAYLOR_A),
+                       vmul(vset(TAYLOR_B),
+                            vadd(vmul(gx, gx), vmul(gy, gy))));
+    gx = vmul(gx, norm);
+    gy = vmul(gy, norm);
+}
+
+inline vfloat vcorner(vfloat i, vfloat fx, vfloat fy) {
+    vfloat gx, gy;
+    vgradient(i, gx, gy);
+    return vadd(vmul(gx, fx), vmul(gy, fy));
+}
+
+inline vfloat vperlin(vfloat x, vfloat y) {
+    vfloat one = vset(1.0f);
+    vfloat x0 = vfloor(x);
+    vfloat y0 = vfloor(y);
+    vfloat fx0 = vsub(x, x0);
+    vfloat fy0 = vsub(y, y0);
+    vfloat fx1 = vsub(fx0, one);
+    vfloat fy1 = vsub(fy0, one);
+    vfloat ix0 = vmod289Div(x0);
+    vfloat iy0 = vmod289Div(y0);
+    vfloat ix1 = vmod289Div(vadd(x0, one));
+    vfloat iy1 = vmod289Div(vadd(y0, one));
+
+    vfloat px0 = vpermute(ix0);
+    vfloat px1 = vpermute(ix1);
+    vfloat n00 = vcorner(vpermute(vadd(px0, iy0)), fx0, fy0);
+    vfloat n10 = vcorner(vpermute(vadd(px1, iy0)), fx1, fy0);
+    vfloat n01 = vcorner(vpermute(vadd(px0, iy1)), fx0, fy1);
+    vfloat n11 = vcorner(vpermute(vadd(px1, iy1)), fx1, fy1);
+
+    vfloat u = vfade(fx0);
+    vfloat v = vfade(fy0);
+    vfloat iu = vsub(one, u);
+    vfloat iv = vsub(one, v);
+    vfloat nx0 = vadd(vmul(n00, iu), vmul(n10, u));
+    vfloat nx1 = vadd(vmul(n01, iu), vmul(n11, u));
+    return vmul(vset(2.3f), vadd(vmul(nx0, iv), vmul(nx1, v)));
+}
+
+// vperlin() along with its partial derivatives, see perlinNoiseD()
+inline vfloat vperlinD(vfloat x, vfloat y, vfloat &dx, vfloat &dy) {
+    vfloat one = vset(1.0f);
+    vfloat x0 = vfloor(x);
+    vfloat y0 = vfloor(y);
+    vfloat fx0 = vsub(x, x0);
+    vfloat fy0 = vsub(y, y0);
+    vfloat fx1 = vsub(fx0, one);
+    vfloat fy1 = vsub(fy0, one);
+    vfloat ix0 = vmod289Div(x0);
+    vfloat iy0 = vmod289Div(y0);
+    vfloat ix1 = vmod289Div(vadd(x0, one));
+    vfloat iy1 = vmod289Div(vadd(y0, one));
+
+    vfloat px0 = vpermute(ix0);
+    vfloat px1 = vpermute(ix1);
+    vfloat g00x, g00y, g10x, g10y, g01x, g01y, g11x, g11y;
+    vgradient(vpermute(vadd(px0, iy0)), g00x, g00y);
+    vgradient(vpermute(vadd(px1, iy0)), g10x, g10y);
+    vgradient(vpermute(vadd(px0, iy1)), g01x, g01y);
+    vgradient(vpermute(vadd(px1, iy1)), g11x, g11y);
+    vfloat n00 = vadd(vmul(g00x, fx0), vmul(g00y, fy0));
+    vfloat n10 = vadd(vmul(g10x, fx1), vmul(g10y, fy0));
+    vfloat n01 = vadd(vmul(g01x, fx0), vmul(g01y, fy1));
+    vfloat n11 = vadd(vmul(g11x, fx1), vmul(g11y, fy1));
+
+    vfloat u = vfade(fx0);
+    vfloat v = vfade(fy0);
+    vfloat du = vfadeDeriv(fx0);
+    vfloat dv = vfadeDeriv(fy0);
+    vfloat iu = vsub(one, u);
+    vfloat iv = vsub(one, v);
+    vfloat nx0 = vadd(vmul(n00, iu), vmul(n10, u));
+    vfloat nx1 = vadd(vmul(n01, iu), vmul(n11, u));
+
+    vfloat dnx0_dx = vadd(vadd(vmul(g00x, iu), vmul(g10x, u)),
+                          vmul(vsub(n10, n00), du));
+    vfloat dnx1_dx = vadd(vadd(vmul(g01x, iu), vmul(g11x, u)),
+                          vmul(vsub(n11, n01), du));
+    vfloat dnx0_dy = vadd(vmul(g00y, iu), vmul(g10y, u));
+    vfloat dnx1_dy = vadd(vmul(g01y, iu), vmul(g11y, u));
+    vfloat scale = vset(2.3f);
+    dx = vmul(scale, vadd(vmul(dnx0_dx, iv), vmul(dnx1_dx, v)));
+    dy = vmul(scale, vadd(vadd(vmul(dnx0_dy, iv), vmul(dnx1_dy, v)),
+                          vmul(vsub(nx1, nx0), dv)));
+    return vmul(scale, vadd(vmul(nx0, iv), vmul(nx1, v)));
+}
+
+inline vfloat vterrainHeight(vfloat x, vfloat y, const NoiseParams &p) {
+    float ox, oy;
+    seedOffset(p.seed, ox, oy);
+    x = vadd(vmul(x, vset(p.lateral_scaling)), vset(ox));
+    y = vadd(vmul(y, vset(p.lateral_scaling)), vset(oy));
+    vfloat total = vset(0.0f);
+    float frequency = 1.0f;
+    float amplitude = 1.0f;
+    float max_value = 0.0f;
+    for (int i = 0; i < p.octaves; i++) {
+        vfloat f = vset(frequency);
+        total = vadd(total,
+                     vmul(vperlin(vmul(x, f), vmul(y, f)), vset(amplitude)));
+        max_value += amplitude;
+        amplitude *= p.persistence;
+        frequency *= 2.0f;
+    }
+    vfloat val = vadd(vmul(vdiv(total, vset(max_value)),
+                           vset(p.vertical_scaling)),
+                      vset(p.vertical_offset));
+    return vmax(val, vset(p.min_elevation));
+}
+
+inline vfloat vterrainHeightD(vfloat x, vfloat y, const NoiseParams &p,
+                              vfloat &dx, vfloat &dy) {
+    float ox, oy;
+    seedOffset(p.seed, ox, oy);
+    x = vadd(vmul(x, vset(p.lateral_scaling)), vset(ox));
+    y = vadd(vmul(y, vset(p.lateral_scaling)), vset(oy));
+    vfloat total = vset(0.0f);
+    dx = vset(0.0f);
+    dy = vset(0.0f);
+    float frequency = 1.0f;
+    float amplitude = 1.0f;
+    float max_value = 0.0f;
+    for (int i = 0; i < p.octaves; i++) {
+        vfloat f = vset(frequency);
+        vfloat a = vset(amplitude);
+        vfloat af = vset(amplitude * frequency);
+        vfloat ndx, ndy;
+        vfloat n = vperlinD(vmul(x, f), vmul(y, f), ndx, ndy);
+        total = vadd(total, vmul(n, a));
+        dx = vadd(dx, vmul(ndx, af));
+        dy = vadd(dy, vmul(ndy, af));
+        max_value += amplitude;
+        amplitude *= p.persistence;
+        frequency *= 2.0f;
+    }
+    vfloat m = vset(max_value);
+    vfloat val = vadd(vmul(vdiv(total, m), vset(p.vertical_scaling)),
+                      vset(p.vertical_offset));
+    vfloat slope_scale = vset(p.lateral_scaling * p.vertical_scaling);
+    vfloat lo = vset(p.min_elevation);
+    dx = vzeroBelow(vmul(vdiv(dx, m), slope_scale), val, lo);
+    dy = vzeroBelow(vmul(vdiv(dy, m), slope_scale), val, lo);
+    return vmax(val, lo);
+}
+#endif
+} // namespace noise_detail
+
+// Fills out[0..n) with terrain heights sampled at (xs[i], y)
+inline void terrainHeightRow(const float *xs, float y, unsigned int n,
+                             const NoiseParams &p, float *out) {
+    unsigned int i = 0;
+#ifdef NOISE_SIMD
+    using namespace noise_detail;
+    vfloat vy = vset(y);
+    for (; i + LANES <= n; i += LANES) {
+        vstore(out + i, vterrainHeight(vload(xs + i), vy, p));
+    }
+#endif
+    // Scalar tail (or the whole row when there is no SIMD)
+    for (; i < n; i++) {
+        out[i] = terrainHeight(xs[i], y, p);
+    }
+}
+
+// terrainHeightRow() plus the slope of every sample along x and y
+inline void terrainHeightRowD(const float *xs, float y, unsigned int n,
+                              const NoiseParams &p, float *out,
+                              float *out_dx, float *out_dy) {
+    unsigned int i = 0;
+#ifdef NOISE_SIMD
+    using namespace noise_detail;
+    vfloat vy = vset(y);
+    for (; i + LANES <= n; i += LANES) {
+        vfloat dx, dy;
+        vstore(out + i, vterrainHeightD(vload(xs + i), vy, p, dx, dy));
+        vstore(out_dx + i, dx);
+        vstore(out_dy + i, dy);
+    }
+#endif
+    for (; i < n; i++) {
+        out[i] = terrainHeightD(xs[i], y, p, out_dx[i], out_dy[i]);
+    }
+}
+
+// Fills a w x h row-major tile of heights sampled at (xs[c], ys[r])
+inline void terrainHeightTile(const float *xs, const float *ys, unsigned int w,
+                              unsigned int h, const NoiseParams &p,
+                              float *out) {
+    for (unsigned int r = 0; r < h; r++) {
+        terrainHeightRow(xs, ys[r], w, p, out + r * w);
+    }
+}
@@ -0,0 +1,318 @@
+#pragma once
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <JobSystem.h>
+#include <MappedFile.h>
+#include <TextScanner.h>
+
+// Geometry of a Wavefront OBJ file, triangulated
+struct ObjMesh {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> uvs;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec3> colors; // per position, from usergb (black if none)
+    // 0-based corners of every triangle. uv and normal indices are -1 when
+    // the face doesn't give them.
+    std::vector<glm::ivec3> triangles;
+    std::vector<glm::ivec3> triangle_uvs;
+    std::vector<glm::ivec3> triangle_normals;
+};
+
+/*
+    Parallel Wavefront OBJ parser.
+
+    The file is memory-mapped and cut into chunks at line boundaries; every
+    chunk is scanned on its own worker with TextScanner's allocation-free
+    number parsing. A sequential merge then concatenates the chunks, turns
+    relative (negative) indices into absolute ones and applies usergb colors
+    in file order, which are the only things that depend on earlier chunks.
+
+    Supported: v, vt, vn, usergb and f lines. Faces may use any of the
+    v, v/vt, v//vn and v/vt/vn corner forms, and polygons are fan
+    triangulated. Anything else (o, g, s, usemtl, comments...) is skipped.
+*/
+class ObjParser {
+  private:
+    // A face corner: position, uv and normal index, -1 when absent
+    struct Corner {
+        int v;
+        int vt;
+        int vn;
+    };
+
+    // What one chunk of lines produced, with chunk-local relative indices
+    struct Chunk {
+        const char *begin;
+        const char *end;
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec2> uvs;
+        std::vector<glm::vec3> normals;
+        std::vector<glm::vec3> palette; // usergb colors in order
+        std::vector<Corner> corners;    // 3 per triangle
+        std::vector<int> colors; // palette index per triangle, -1 inherited
+        // Corner slots (index * 3 + component) holding a negative index,
+        // stored relative to this chunk's first element
+        std::vector<size_t> relative;
+        unsigned int bad_faces = 0;
+    };
+
+    static const size_t MIN_CHUNK_BYTES = 1 << 20;
+
+    // Converts a 1-based or negative OBJ index, -1 if it is 0
+    static int resolve(int raw, size_t local_count, Chunk &chunk, size_t slot) {
+        if (raw > 0) {
+            return raw - 1;
+        }
+        if (raw < 0) {
+            chunk.relative.push_back(slot);
+            return (int)local_count + raw;
+        }
+        return -1;
+    }
+
+    // Parses one corner: v, v/vt, v//vn or v/vt/vn
+    static bool scanCorner(const char *&p, const char *end, int raw[3]) {
+        raw[1] = raw[2] = 0;
+        if (!text_scan::scanInt(p, end, raw[0])) {
+            return false;
+        }
+        if (p < end && *p == '/') {
+            p++;
+            if (p < end && *p != '/' && !text_scan::scanInt(p, end, raw[1])) {
+                return false;
+            }
+            if (p < end && *p == '/') {
+                p++;
+                if (!text_scan::scanInt(p, end, raw[2])) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Fan-triangulates the corners of an f line
+    static void scanFace(const char *&p, const char *end, Chunk &chunk,
+                         std::vector<Corner> &polygon) {
+        polygon.clear();
+        int raw[3];
+        bool is_valid = true;
+        while (true) {
+            text_scan::skipBlanks(p, end);
+            if (p == end || *p == '\n' || *p == '#') {
+                break;
+            }
+            if (!scanCorner(p, end, raw)) {
+                is_valid = false;
+                break;
+            }
+            Corner c;
+            c.v = raw[0];
+            c.vt = raw[1];
+            c.vn = raw[2];
+            polygon.push_back(c);
+        }
+        if (!is_valid || polygon.size() < 3) {
+            chunk.bad_faces++;
+            return;
+        }
+        int color = (int)chunk.palette.size() - 1;
+        for (size_t i = 1; i + 1 < polygon.size(); i++) {
+            const Corner *tri[3] = {&polygon[0], &polygon[i], &polygon[i + 1]};
+            for (int k = 0; k < 3; k++) {
+                size_t slot = chunk.corners.size() * 3;
+                Corner c;
+                c.v = resolve(tri[k]->v, chunk.positions.size(), chunk, slot);
+                c.vt = resolve(tri[k]->vt, chunk.uvs.size(), chunk, slot + 1);
+                c.vn =
+                    resolve(tri[k]->vn, chunk.normals.size(), chunk, slot + 2);
+                chunk.corners.push_back(c);
+            }
+            chunk.colors.push_back(color);
+        }
+    }
+
+    static void parseChunk(Chunk &chunk) {
+        using namespace text_scan;
+        const char *p = chunk.begin;
+        const char *end = chunk.end;
+        std::vector<Corner> polygon;
+        while (p < end) {
+            skipBlanks(p, end);
+            if (p == end) {
+                break;
+            }
+            const char *word = p;
+            while (p < end && !isBlank(*p) && *p != '\n') {
+                p++;
+            }
+            size_t n = p - word;
+            if (n == 1 && word[0] == 'v') {
+                glm::vec3 v(0.0f);
+                scanFloat(p, end, v.x);
+                scanFloat(p, end, v.y);
+                scanFloat(p, end, v.z);
+                chunk.positions.push_back(v);
+            } else if (n == 2 && word[0] == 'v' && word[1] == 't') {
+                glm::vec2 uv(0.0f);
+                scanFloat(p, end, uv.x);
+                scanFloat(p, end, uv.y);
+                chunk.uvs.push_back(uv);
+            } else if (n == 2 && word[0] == 'v' && word[1] == 'n') {
+                glm::vec3 normal(0.0f);
+                scanFloat(p, end, normal.x);
+                scanFloat(p, end, normal.y);
+                scanFloat(p, end, normal.z);
+                chunk.normals.push_back(normal);
+            } else if (n == 1 && word[0] == 'f') {
+                scanFace(p, end, chunk, polygon);
+            } else if (n == 6 && strncmp(word, "usergb", 6) == 0) {
+                glm::vec3 color(0.0f);
+                scanFloat(p, end, color.x);
+                scanFloat(p, end, color.y);
+                scanFloat(p, end, color.z);
+                chunk.palette.push_back(color);
+            }
+            skipLine(p, end);
+        }
+    }
+
+    // Splits [begin, end) into about n pieces that end on a newline
+    static std::vector<Chunk> split(const char *begin, const char *end,
+                                    unsigned int n) {
+        std::vector<Chunk> chunks;
+        const char *p = begin;
+        size_t step = (end - begin) / n + 1;
+        while (p < end) {
+            const char *q = (size_t)(end - p) > step ? p + step : end;
+            text_scan::skipLine(q, end);
+            Chunk chunk;
+            chunk.begin = p;
+            chunk.end = q;
+            chunks.push_back(chunk);
+            p = q;
+        }
+        return chunks;
+    }
+
+  public:
+    // Parses path into mesh, spreading chunks over jobs when given. Returns
+    // false if the file can't be read.
+    static bool load(const std::string &path, ObjMesh &mesh,
+                     JobSystem *jobs = nullptr) {
+        auto start = std::chrono::steady_clock::now();
+        MappedFile file;
+        if (!file.open(path)) {
+            return false;
+        }
+
+        unsigned int workers = jobs != nullptr ? jobs->size() : 1;
+        unsigned int n = std::max<size_t>(
+            1, std::min<size_t>(workers * 4, file.size() / MIN_CHUNK_BYTES));
+        std::vector<Chunk> chunks = split(file.begin(), file.end(), n);
+        auto parse = [&](unsigned int b, unsigned int e) {
+            for (unsigned int i = b; i < e; i++) {
+                parseChunk(chunks[i]);
+            }
+        };
+        if (jobs != nullptr && chunks.size() > 1) {
+            jobs->parallelFor(0, chunks.size(), 1, parse);
+        } else {
+            parse(0, chunks.size());
+        }
+
+        // Element counts before each chunk
+        size_t num_positions = 0, num_uvs = 0, num_normals = 0, num_tris = 0;
+        for (Chunk &c : chunks) {
+            num_positions += c.positions.size();
+            num_uvs += c.uvs.size();
+            num_normals += c.normals.size();
+            num_tris += c.colors.size();
+        }
+        mesh = ObjMesh();
+        mesh.positions.reserve(num_positions);
+        mesh.uvs.reserve(num_uvs);
+        mesh.normals.reserve(num_normals);
+        mesh.triangles.reserve(num_tris);
+        mesh.triangle_uvs.reserve(num_tris);
+        mesh.triangle_normals.reserve(num_tris);
+        mesh.colors.assign(num_positions, glm::vec3(0.0f));
+
+        unsigned int bad_faces = 0;
+        unsigned int bad_triangles = 0;
+        glm::vec3 current_color(0.0f);
+        for (Chunk &c : chunks) {
+            const int offsets[3] = {(int)mesh.positions.size(),
+                                    (int)mesh.uvs.size(),
+                                    (int)mesh.normals.size()};
+            const int counts[3] = {(int)num_positions, (int)num_uvs,
+                                   (int)num_normals};
+            for (size_t slot : c.relative) {
+                Corner &corner = c.corners[slot / 3];
+                int &index = slot % 3 == 0   ? corner.v
+                             : slot % 3 == 1 ? corner.vt
+                                             : corner.vn;
+                index += offsets[slot % 3];
+            }
+            mesh.positions.insert(mesh.positions.end(), c.positions.begin(),
+                                  c.positions.end());
+            mesh.uvs.insert(mesh.uvs.end(), c.uvs.begin(), c.uvs.end());
+            mesh.normals.insert(mesh.normals.end(), c.normals.begin(),
+                                c.normals.end());
+
+            glm::vec3 inherited = current_color;
+            for (size_t t = 0; t < c.colors.size(); t++) {
+                const Corner *tri = &c.corners[t * 3];
+                bool is_valid = true;
+                for (int k = 0; k < 3; k++) {
+                    // Positions are required, uvs and normals optional
+                    is_valid = is_valid && tri[k].v >= 0 &&
+                               tri[k].v < counts[0] && tri[k].vt >= -1 &&
+                               tri[k].vt < counts[1] && tri[k].vn >= -1 &&
+                               tri[k].vn < counts[2];
+                }
+                if (!is_valid) {
+                    bad_triangles++;
+                    continue;
+                }
+                mesh.triangles.push_back(
+                    glm::ivec3(tri[0].v, tri[1].v, tri[2].v));
+                mesh.triangle_uvs.push_back(
+                    glm::ivec3(tri[0].vt, tri[1].vt, tri[2].vt));
+                mesh.triangle_normals.push_back(
+                    glm::ivec3(tri[0].vn, tri[1].vn, tri[2].vn));
+                // Last face to touch a vertex sets its color
+                glm::vec3 color =
+                    c.colors[t] >= 0 ? c.palette[c.colors[t]] : inherited;
+                for (int k = 0; k < 3; k++) {
+                    mesh.colors[tri[k].v] = color;
+                }
+            }
+            if (!c.palette.empty()) {
+                current_color = c.palette.back();
+            }
+            bad_faces += c.bad_faces;
+        }
+
+        double ms = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+        std::cout << "OBJ: " << path << ", " << mesh.positions.size()
+                  << " vertices, " << mesh.triangles.size() << " triangles, "
+                  << file.size() / 1024 << " KB in " << ms << " ms ("
+                  << chunks.size() << " chunks)" << std::endl;
+        if (bad_faces > 0 || bad_triangles > 0) {
+            std::cout << "OBJ: skipped " << bad_faces
+                      << " malformed faces and " << bad_triangles
+                      << " triangles with out of range indices" << std::endl;
+        }
+        return true;
+    }
+};
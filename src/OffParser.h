@@ -0,0 +1,358 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <MappedFile.h>
+#include <TextScanner.h>
+
+// Geometry of an OFF file, triangulated
+struct OffMesh {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals; // NOFF only, one per position
+    std::vector<glm::vec3> colors;  // COFF only, one per position, 0..1
+    std::vector<glm::ivec3> triangles;
+};
+
+/*
+    Streaming Geomview OFF reader, ASCII and binary.
+
+    One pass over the memory-mapped file: numbers are scanned in place with
+    TextScanner, so no line strings, token substrings or regexes are built,
+    and the output vectors are sized from the header counts up front.
+
+    Handles '#' comments anywhere in the text, the optional ST / C / N
+    header prefixes (texture coords are skipped, colors and normals kept),
+    faces of any arity (fan triangulated, trailing face colors ignored) and
+    "OFF BINARY" files, whose counts, vertices and faces are big-endian
+    32-bit values.
+
+    Text vertices are read token by token, so they may share or span lines.
+    Only the optional values (a color's alpha, texture coords) must sit on
+    the line the vertex ends on. Colors written as integers are 0..255,
+    colors written as floats 0..1.
+*/
+class OffParser {
+  private:
+    // Per-vertex layout announced by the header keyword
+    struct Layout {
+        bool has_uv = false;     // ST
+        bool has_color = false;  // C
+        bool has_normal = false; // N
+        bool is_binary = false;
+    };
+
+    // Skips whitespace, newlines and comments up to the next token
+    static void skipToToken(const char *&p, const char *end) {
+        while (p < end) {
+            if (*p == '#') {
+                text_scan::skipLine(p, end);
+            } else if (text_scan::isBlank(*p) || *p == '\n') {
+                p++;
+            } else {
+                break;
+            }
+        }
+    }
+
+    static bool nextInt(const char *&p, const char *end, int &out) {
+        skipToToken(p, end);
+        return text_scan::scanInt(p, end, out);
+    }
+
+    static bool nextFloat(const char *&p, const char *end, float &out) {
+        skipToToken(p, end);
+        return text_scan::scanFloat(p, end, out);
+    }
+
+    // nextFloat() that also clears is_integer if the token has a fraction
+    // or an exponent
+    static bool nextComponent(const char *&p, const char *end, float &out,
+                              bool &is_integer) {
+        skipToToken(p, end);
+        const char *start = p;
+        if (!text_scan::scanFloat(p, end, out)) {
+            return false;
+        }
+        for (const char *c = start; c < p; c++) {
+            if (*c == '.' || *c == 'e' || *c == 'E') {
+                is_integer = false;
+            }
+        }
+        return true;
+    }
+
+    // Scans up to max_count numbers that follow on the current line
+    static void sameLineFloats(const char *&p, const char *end, float *out,
+                               int max_count) {
+        for (int i = 0; i < max_count; i++) {
+            if (!text_scan::scanFloat(p, end, out[i])) {
+                return;
+            }
+        }
+    }
+
+    // Parses "[ST][C][N]OFF [BINARY]"
+    static bool scanHeader(const char *&p, const char *end, Layout &layout) {
+        skipToToken(p, end);
+        const char *word = p;
+        while (p < end && !text_scan::isBlank(*p) && *p != '\n') {
+            p++;
+        }
+        std::string keyword(word, p);
+        if (keyword.size() < 3 ||
+            keyword.compare(keyword.size() - 3, 3, "OFF") != 0) {
+            return false;
+        }
+        std::string prefix = keyword.substr(0, keyword.size() - 3);
+        if (prefix.compare(0, 2, "ST") == 0) {
+            layout.has_uv = true;
+            prefix = prefix.substr(2);
+        }
+        if (!prefix.empty() && prefix[0] == 'C') {
+            layout.has_color = true;
+            prefix = prefix.substr(1);
+        }
+        if (!prefix.empty() && prefix[0] == 'N') {
+            layout.has_normal = true;
+            prefix = prefix.substr(1);
+        }
+        if (!prefix.empty()) {
+            std::cout << "OFF: unsupported header " << keyword << std::endl;
+            return false;
+        }
+        text_scan::skipBlanks(p, end);
+        if (end - p >= 6 && strncmp(p, "BINARY", 6) == 0) {
+            layout.is_binary = true;
+            text_scan::skipLine(p, end); // binary data starts on the next line
+        }
+        return true;
+    }
+
+    static uint32_t readBigEndian(const char *&p) {
+        const unsigned char *b = (const unsigned char *)p;
+        p += 4;
+        return (uint32_t)b[0] << 24 | (uint32_t)b[1] << 16 |
+               (uint32_t)b[2] << 8 | (uint32_t)b[3];
+    }
+
+    static float readFloat(const char *&p) {
+        uint32_t bits = readBigEndian(p);
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+
+    // Adds the fan of a polygon, skipping corners that are out of range
+    static void addPolygon(const std::vector<int> &polygon, OffMesh &mesh,
+                           unsigned int &bad_faces) {
+        int n = (int)mesh.positions.size();
+        for (int v : polygon) {
+            if (v < 0 || v >= n) {
+                bad_faces++;
+                return;
+            }
+        }
+        for (size_t i = 1; i + 1 < polygon.size(); i++) {
+            mesh.triangles.push_back(
+                glm::ivec3(polygon[0], polygon[i], polygon[i + 1]));
+        }
+    }
+
+    static bool readText(const char *p, const char *end, const Layout &layout,
+                         int num_vertices, int num_faces, OffMesh &mesh,
+                         unsigned int &bad_faces) {
+        for (int i = 0; i < num_vertices; i++) {
+            glm::vec3 v;
+            if (!nextFloat(p, end, v.x) || !nextFloat(p, end, v.y) ||
+                !nextFloat(p, end, v.z)) {
+                return false;
+            }
+            mesh.positions.push_back(v);
+            if (layout.has_normal) {
+                glm::vec3 n;
+                if (!nextFloat(p, end, n.x) || !nextFloat(p, end, n.y) ||
+                    !nextFloat(p, end, n.z)) {
+                    return false;
+                }
+                mesh.normals.push_back(n);
+            }
+            bool has_alpha = false;
+            if (layout.has_color) {
+                // RGB, 0..255 if every component is written as an integer
+                glm::vec3 rgb;
+                bool is_integer = true;
+                for (int k = 0; k < 3; k++) {
+                    if (!nextComponent(p, end, rgb[k], is_integer)) {
+                        return false;
+                    }
+                }
+                mesh.colors.push_back(is_integer ? rgb / 255.0f : rgb);
+                has_alpha = true;
+            }
+            // Optional alpha and texture coords, both unused: skip up to
+            // that many numbers, but only from the rest of this line
+            float unused[3];
+            sameLineFloats(p, end, unused,
+                           (has_alpha ? 1 : 0) + (layout.has_uv ? 2 : 0));
+        }
+        std::vector<int> polygon;
+        for (int i = 0; i < num_faces; i++) {
+            int n;
+            if (!nextInt(p, end, n)) {
+                return false;
+            }
+            // Every index takes at least 2 characters
+            if (n < 0 || n > (end - p) / 2) {
+                return false;
+            }
+            polygon.resize(n);
+            for (int k = 0; k < n; k++) {
+                if (!nextInt(p, end, polygon[k])) {
+                    return false;
+                }
+            }
+            addPolygon(polygon, mesh, bad_faces);
+            text_scan::skipLine(p, end); // optional face color
+        }
+        return true;
+    }
+
+    static bool readBinary(const char *p, const char *end,
+                           const Layout &layout, int num_vertices,
+                           int num_faces, OffMesh &mesh,
+                           unsigned int &bad_faces) {
+        size_t floats_per_vertex = 3 + (layout.has_normal ? 3 : 0) +
+                                   (layout.has_color ? 4 : 0) +
+                                   (layout.has_uv ? 2 : 0);
+        if ((size_t)(end - p) / 4 / floats_per_vertex < (size_t)num_vertices) {
+            return false;
+        }
+        for (int i = 0; i < num_vertices; i++) {
+            glm::vec3 v;
+            v.x = readFloat(p);
+            v.y = readFloat(p);
+            v.z = readFloat(p);
+            mesh.positions.push_back(v);
+            if (layout.has_normal) {
+                glm::vec3 n;
+                n.x = readFloat(p);
+                n.y = readFloat(p);
+                n.z = readFloat(p);
+                mesh.normals.push_back(n);
+            }
+            if (layout.has_color) {
+                glm::vec3 c;
+                c.x = readFloat(p);
+                c.y = readFloat(p);
+                c.z = readFloat(p);
+                readFloat(p); // alpha
+                mesh.colors.push_back(c);
+            }
+            if (layout.has_uv) {
+                p += 8;
+            }
+        }
+        std::vector<int> polygon;
+        for (int i = 0; i < num_faces; i++) {
+            if (end - p < 4) {
+                return false;
+            }
+            int n = (int)readBigEndian(p);
+            // Corners, then the color count and that many color floats
+            if (n < 0 || (end - p) / 4 < (ptrdiff_t)n + 1) {
+                return false;
+            }
+            polygon.resize(n);
+            for (int k = 0; k < n; k++) {
+                polygon[k] = (int)readBigEndian(p);
+            }
+            uint32_t num_colors = readBigEndian(p);
+            if ((size_t)(end - p) / 4 < num_colors) {
+                return false;
+            }
+            p += num_colors * 4;
+            addPolygon(polygon, mesh, bad_faces);
+        }
+        return true;
+    }
+
+  public:
+    // Parses path into mesh. Returns false if the file can't be read or is
+    // cut short.
+    static bool load(const std::string &path, OffMesh &mesh) {
+        auto start = std::chrono::steady_clock::now();
+        mesh = OffMesh();
+        MappedFile file;
+        if (!file.open(path)) {
+            return false;
+        }
+        const char *p = file.begin();
+        const char *end = file.end();
+        Layout layout;
+        if (!scanHeader(p, end, layout)) {
+            std::cout << "OFF: " << path << " has no OFF header" << std::endl;
+            return false;
+        }
+
+        int num_vertices = 0, num_faces = 0, num_edges = 0;
+        if (layout.is_binary) {
+            if (end - p < 12) {
+                return false;
+            }
+            num_vertices = (int)readBigEndian(p);
+            num_faces = (int)readBigEndian(p);
+            num_edges = (int)readBigEndian(p);
+        } else if (!nextInt(p, end, num_vertices) ||
+                   !nextInt(p, end, num_faces) ||
+                   !nextInt(p, end, num_edges)) {
+            return false;
+        }
+        if (num_vertices < 0 || num_faces < 0) {
+            return false;
+        }
+        // Most meshes are triangles, so faces ~ triangles. The counts are
+        // only trusted as far as the rest of the file could hold them: a
+        // text vertex takes at least 6 bytes ("0 0 0\n"), a face 2, binary
+        // ones 12 and 8.
+        size_t remaining = end - p;
+        size_t min_vertex_bytes = layout.is_binary ? 12 : 6;
+        size_t min_face_bytes = layout.is_binary ? 8 : 2;
+        mesh.positions.reserve(
+            std::min((size_t)num_vertices, remaining / min_vertex_bytes));
+        mesh.triangles.reserve(
+            std::min((size_t)num_faces, remaining / min_face_bytes));
+
+        unsigned int bad_faces = 0;
+        bool is_complete =
+            layout.is_binary
+                ? readBinary(p, end, layout, num_vertices, num_faces, mesh,
+                             bad_faces)
+                : readText(p, end, layout, num_vertices, num_faces, mesh,
+                           bad_faces);
+
+        double ms = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+        std::cout << "OFF: " << path << (layout.is_binary ? " (binary)" : "")
+                  << ", V: " << num_vertices << ", F: " << num_faces
+                  << ", E: " << num_edges << ", " << mesh.triangles.size()
+                  << " triangles in " << ms << " ms" << std::endl;
+        if (bad_faces > 0) {
+            std::cout << "OFF: skipped " << bad_faces
+                      << " faces with out of range indices" << std::endl;
+        }
+        if (!is_complete) {
+            std::cout << "OFF: " << path << " ends early" << std::endl;
+        }
+        return is_complete;
+    }
+};
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+    Scoped CPU timing zones, written out as Chrome trace_event JSON (open
+    the file in chrome://tracing or https://ui.perfetto.dev).
+
+        void updateTerrain() {
+            ProfileZone zone("updateTerrain");
+            ...
+        }
+
+    Every thread records into its own ring of the last RING_SIZE zones, so
+    recording takes no lock: the owning thread is the only writer and
+    publishes each zone by bumping the ring's head. write() copies the
+    rings while threads keep recording, and drops the zones that were
+    overwritten during the copy.
+
+    Zones cost a relaxed atomic load while capture is off. Builds without
+    USE_PROFILER (CMake option, on by default) compile them out entirely.
+
+    Zone names must outlive the profiler, e.g. string literals.
+*/
+class Profiler {
+  public:
+    static const size_t RING_SIZE = 1 << 16; // zones kept per thread
+
+  private:
+    // One finished zone. Fields are atomics so write() may read a slot while
+    // its thread overwrites it; such slots are dropped.
+    struct Zone {
+        std::atomic<const char *> name;
+        std::atomic<int64_t> start_ns;
+        std::atomic<int64_t> duration_ns;
+        std::atomic<int> index;
+    };
+
+    struct Ring {
+        Zone zones[RING_SIZE];
+        std::atomic<uint64_t> head; // zones ever recorded
+        int thread_id;
+        std::string thread_name;
+
+        Ring(int _thread_id) : head(0), thread_id(_thread_id) {}
+    };
+
+    std::atomic<bool> is_capturing;
+    std::atomic<int64_t> capture_start_ns; // zones before it are not written
+    std::mutex rings_mutex;                // guards rings, not their contents
+    std::vector<std::unique_ptr<Ring>> rings;
+
+    Profiler() : is_capturing(false), capture_start_ns(0) {}
+
+    static std::string &threadName() {
+        static thread_local std::string name;
+        return name;
+    }
+
+    // Made on a thread's first zone, so threads that never record while
+    // capturing cost nothing. Rings outlive their threads so a trace still
+    // shows finished workers.
+    Ring &threadRing() {
+        static thread_local Ring *ring = nullptr;
+        if (ring == nullptr) {
+            std::lock_guard<std::mutex> lock(rings_mutex);
+            rings.emplace_back(new Ring((int)rings.size() + 1));
+            ring = rings.back().get();
+            ring->thread_name = threadName().empty()
+                                    ? "thread " + std::to_string(ring->thread_id)
+                                    : threadName();
+        }
+        return *ring;
+    }
+
+  public:
+    static Profiler &get() {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    static bool isCapturing() {
+#ifdef USE_PROFILER
+        return get().is_capturing.load(std::memory_order_relaxed);
+#else
+        return false;
+#endif
+    }
+
+    static int64_t now() {
+        static const std::chrono::steady_clock::time_point epoch =
+            std::chrono::steady_clock::now();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now() - epoch)
+            .count();
+    }
+
+    // Starts a new capture; zones recorded before it are left out of write()
+    bool start() {
+#ifdef USE_PROFILER
+        capture_start_ns = now();
+        is_capturing = true;
+        return true;
+#else
+        std::cout << "Profiler: this build has no profiling zones"
+                  << std::endl;
+        return false;
+#endif
+    }
+    void stop() { is_capturing = false; }
+
+    // Names the calling thread's track in the trace. Call before the
+    // thread's first zone.
+    static void setThreadName(const std::string &name) { threadName() = name; }
+
+    // Called by ProfileZone on the zone's own thread
+    void record(const char *name, int64_t start_ns, int64_t end_ns,
+                int index) {
+        Ring &ring = threadRing();
+        uint64_t head = ring.head.load(std::memory_order_relaxed);
+        // A reader that sees the stores below also sees the last head bump
+        std::atomic_thread_fence(std::memory_order_release);
+        Zone &zone = ring.zones[head % RING_SIZE];
+        zone.name.store(name, std::memory_order_relaxed);
+        zone.start_ns.store(start_ns, std::memory_order_relaxed);
+        zone.duration_ns.store(end_ns - start_ns, std::memory_order_relaxed);
+        zone.index.store(index, std::memory_order_relaxed);
+        ring.head.store(head + 1, std::memory_order_release);
+    }
+
+    // Writes the zones of the current capture, of every thread
+    bool write(const std::string &path) {
+        std::ofstream out(path);
+        if (!out) {
+            std::cout << "Profiler: could not write " << path << std::endl;
+            return false;
+        }
+        int64_t since_ns = capture_start_ns;
+        size_t num_zones = 0;
+        out << std::fixed << std::setprecision(3);
+        out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        out << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, "
+               "\"args\": {\"name\": \"infinityterrain\"}}";
+
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        for (const std::unique_ptr<Ring> &ring : rings) {
+            out << ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+                << "\"tid\": " << ring->thread_id << ", \"args\": {\"name\": \""
+                << ring->thread_name << "\"}}";
+
+            // Copy first, then keep only the slots not overwritten meanwhile.
+            // Slot head - RING_SIZE may be mid-write, so it never counts.
+            uint64_t end = ring->head.load(std::memory_order_acquire);
+            uint64_t begin = end >= RING_SIZE ? end - RING_SIZE + 1 : 0;
+            struct Copy {
+                const char *name;
+                int64_t start_ns, duration_ns;
+                int index;
+            };
+            std::vector<Copy> zones;
+            zones.reserve(end - begin);
+            for (uint64_t i = begin; i < end; i++) {
+                const Zone &zone = ring->zones[i % RING_SIZE];
+                zones.push_back({zone.name.load(std::memory_order_relaxed),
+                                 zone.start_ns.load(std::memory_order_relaxed),
+                                 zone.duration_ns.load(
+                                     std::memory_order_relaxed),
+                                 zone.index.load(std::memory_order_relaxed)});
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            uint64_t overwritten = ring->head.load(std::memory_order_relaxed);
+            uint64_t first_intact =
+                overwritten >= RING_SIZE ? overwritten - RING_SIZE + 1 : 0;
+
+            for (uint64_t i = std::max(begin, first_intact); i < end; i++) {
+                const Copy &zone = zones[i - begin];
+                if (zone.start_ns < since_ns) {
+                    continue;
+                }
+                out << ",\n{\"name\": \"" << zone.name
+                    << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": "
+                    << ring->thread_id << ", \"ts\": " << zone.start_ns / 1e3
+                    << ", \"dur\": " << zone.duration_ns / 1e3;
+                if (zone.index >= 0) {
+                    out << ", \"args\": {\"index\": " << zone.index << "}";
+                }
+                out << "}";
+                num_zones++;
+            }
+        }
+        out << "\n]}\n";
+        if (!out) {
+            return false;
+        }
+        std::cout << "Profiler: wrote " << num_zones << " zones of "
+                  << rings.size() << " threads to " << path << std::endl;
+        return true;
+    }
+};
+
+// Times the enclosing scope, on the calling thread's track. index, when
+// given, tells repeated zones apart, e.g. the scene object being drawn.
+class ProfileZone {
+  private:
+    const char *name;
+    int index;
+    int64_t start_ns;
+
+  public:
+    ProfileZone(const char *_name, int _index = -1)
+        : name(_name), index(_index),
+          start_ns(Profiler::isCapturing() ? Profiler::now() : -1) {}
+
+    ~ProfileZone() {
+        if (start_ns >= 0) {
+            Profiler::get().record(name, start_ns, Profiler::now(), index);
+        }
+    }
+
+    ProfileZone(const ProfileZone &) = delete;
+    ProfileZone &operator=(const ProfileZone &) = delete;
+};
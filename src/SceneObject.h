@@ -136,6 +136,17 @@ class SceneObject {
         updateModel();
     }
 
+    // Bounding sphere of the mesh in world space, as of the last
+    // updateModel()
+    void getWorldBounds(glm::vec3 &world_center, float &world_radius) {
+        world_center = mesh->GetWorldCenter(ModelMatrix);
+        float sx = glm::length(glm::vec3(ModelMatrix[0]));
+        float sy = glm::length(glm::vec3(ModelMatrix[1]));
+        float sz = glm::length(glm::vec3(ModelMatrix[2]));
+        float max_scale = glm::max(sx, glm::max(sy, sz));
+        world_radius = mesh->mesh_radius * max_scale;
+    }
+
     bool checkIntersection(glm::vec3 normalized_click_ray,
                            glm::vec3 ray_origin) {
         updateModel();
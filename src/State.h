@@ -20,6 +20,7 @@ struct State {
     bool has_set_last_move = false;
     bool is_left_mouse_pressed = false;
     bool should_use_secondary_renderer = false;
+    bool should_show_stats = false; // performance overlay
     float viewport_scaling = 1.0f; // retina screen?
     float aspect_ratio;
     float current_zoom = 1.0f;
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <string>
+#include <vector>
+
+#include "lib/Helpers.h"
+
+/*
+    Lines of text drawn over the top-left corner of the frame, for the
+    performance stats.
+
+    Glyphs come from a built-in 5x7 font (ASCII 32 to 95; lowercase is
+    drawn as uppercase), packed into a one-channel texture at init(). Every
+    character is one textured quad of its 6x9 cell, on a translucent dark
+    background, scaled up by SCALE; a whole overlay is one draw call.
+
+    Usage, every frame it is shown: clear(), addLine() each line, then
+    draw() with the target framebuffer bound.
+*/
+class StatsOverlay {
+  public:
+    static const int SCALE = 2;         // screen pixels per font pixel
+    static const int CELL_WIDTH = 6;    // glyph columns plus spacing
+    static const int CELL_HEIGHT = 9;   // glyph rows plus spacing
+    static const int MARGIN = 4;        // font pixels from the frame corner
+    static const int FIRST_CHAR = 32;   // ' '
+    static const int NUM_CHARS = 64;    // up to '_'
+    static const int FONT_HEIGHT = 8;   // texture rows (7 used)
+
+  private:
+    // Columns of each glyph, bit 0 at the top
+    static const unsigned char *font() {
+        static const unsigned char FONT[NUM_CHARS][5] = {
+            {0x00, 0x00, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x5F, 0x00, 0x00},
+            {0x00, 0x07, 0x00, 0x07, 0x00}, {0x14, 0x7F, 0x14, 0x7F, 0x14},
+            {0x24, 0x2A, 0x7F, 0x2A, 0x12}, {0x23, 0x13, 0x08, 0x64, 0x62},
+            {0x36, 0x49, 0x55, 0x22, 0x50}, {0x00, 0x05, 0x03, 0x00, 0x00},
+            {0x00, 0x1C, 0x22, 0x41, 0x00}, {0x00, 0x41, 0x22, 0x1C, 0x00},
+            {0x14, 0x08, 0x3E, 0x08, 0x14}, {0x08, 0x08, 0x3E, 0x08, 0x08},
+            {0x00, 0x50, 0x30, 0x00, 0x00}, {0x08, 0x08, 0x08, 0x08, 0x08},
+            {0x00, 0x60, 0x60, 0x00, 0x00}, {0x20, 0x10, 0x08, 0x04, 0x02},
+            {0x3E, 0x51, 0x49, 0x45, 0x3E}, {0x00, 0x42, 0x7F, 0x40, 0x00},
+            {0x42, 0x61, 0x51, 0x49, 0x46}, {0x21, 0x41, 0x45, 0x4B, 0x31},
+            {0x18, 0x14, 0x12, 0x7F, 0x10}, {0x27, 0x45, 0x45, 0x45, 0x39},
+            {0x3C, 0x4A, 0x49, 0x49, 0x30}, {0x01, 0x71, 0x09, 0x05, 0x03},
+            {0x36, 0x49, 0x49, 0x49, 0x36}, {0x06, 0x49, 0x49, 0x29, 0x1E},
+            {0x00, 0x36, 0x36, 0x00, 0x00}, {0x00, 0x56, 0x36, 0x00, 0x00},
+            {0x08, 0x14, 0x22, 0x41, 0x00}, {0x14, 0x14, 0x14, 0x14, 0x14},
+            {0x00, 0x41, 0x22, 0x14, 0x08}, {0x02, 0x01, 0x51, 0x09, 0x06},
+            {0x32, 0x49, 0x79, 0x41, 0x3E}, {0x7E, 0x11, 0x11, 0x11, 0x7E},
+            {0x7F, 0x49, 0x49, 0x49, 0x36}, {0x3E, 0x41, 0x41, 0x41, 0x22},
+            {0x7F, 0x41, 0x41, 0x22, 0x1C}, {0x7F, 0x49, 0x49, 0x49, 0x41},
+            {0x7F, 0x09, 0x09, 0x09, 0x01}, {0x3E, 0x41, 0x49, 0x49, 0x7A},
+            {0x7F, 0x08, 0x08, 0x08, 0x7F}, {0x00, 0x41, 0x7F, 0x41, 0x00},
+            {0x20, 0x40, 0x41, 0x3F, 0x01}, {0x7F, 0x08, 0x14, 0x22, 0x41},
+            {0x7F, 0x40, 0x40, 0x40, 0x40}, {0x7F, 0x02, 0x0C, 0x02, 0x7F},
+            {0x7F, 0x04, 0x08, 0x10, 0x7F}, {0x3E, 0x41, 0x41, 0x41, 0x3E},
+            {0x7F, 0x09, 0x09, 0x09, 0x06}, {0x3E, 0x41, 0x51, 0x21, 0x5E},
+            {0x7F, 0x09, 0x19, 0x29, 0x46}, {0x46, 0x49, 0x49, 0x49, 0x31},
+            {0x01, 0x01, 0x7F, 0x01, 0x01}, {0x3F, 0x40, 0x40, 0x40, 0x3F},
+            {0x1F, 0x20, 0x40, 0x20, 0x1F}, {0x3F, 0x40, 0x38, 0x40, 0x3F},
+            {0x63, 0x14, 0x08, 0x14, 0x63}, {0x07, 0x08, 0x70, 0x08, 0x07},
+            {0x61, 0x51, 0x49, 0x45, 0x43}, {0x00, 0x7F, 0x41, 0x41, 0x00},
+            {0x02, 0x04, 0x08, 0x10, 0x20}, {0x00, 0x41, 0x41, 0x7F, 0x00},
+            {0x04, 0x02, 0x01, 0x02, 0x04}, {0x40, 0x40, 0x40, 0x40, 0x40},
+        };
+        return &FONT[0][0];
+    }
+
+    Program program;
+    VertexArrayObject VAO;
+    GLuint vertex_buffer = 0;
+    GLuint texture = 0;
+    std::vector<std::string> lines;
+    std::vector<float> vertices; // x, y, u, v per corner, rebuilt per draw
+
+    // Two triangles covering font cell (col, row) of the overlay with glyph c
+    void addQuad(int col, int row, char c, int width, int height) {
+        int glyph = std::toupper((unsigned char)c) - FIRST_CHAR;
+        if (glyph < 0 || glyph >= NUM_CHARS) {
+            glyph = '?' - FIRST_CHAR;
+        }
+        // Font pixels to clip space, y down from the top edge
+        float x0 = (MARGIN + col * CELL_WIDTH) * SCALE * 2.0f / width - 1.0f;
+        float y0 = 1.0f - (MARGIN + row * CELL_HEIGHT) * SCALE * 2.0f / height;
+        float x1 = x0 + CELL_WIDTH * SCALE * 2.0f / width;
+        float y1 = y0 - CELL_HEIGHT * SCALE * 2.0f / height;
+        float u0 = (float)glyph / NUM_CHARS;
+        float u1 = (float)(glyph + 1) / NUM_CHARS;
+        // Rows past the glyph's sample outside the texture, i.e. background
+        float v1 = (float)CELL_HEIGHT / FONT_HEIGHT;
+        float corners[6][4] = {{x0, y0, u0, 0.0f}, {x0, y1, u0, v1},
+                               {x1, y0, u1, 0.0f}, {x1, y0, u1, 0.0f},
+                               {x0, y1, u0, v1},   {x1, y1, u1, v1}};
+        for (int i = 0; i < 6; i++) {
+            vertices.insert(vertices.end(), corners[i], corners[i] + 4);
+        }
+    }
+
+  public:
+    bool init() {
+        // One glyph per CELL_WIDTH columns, the last column left blank
+        std::vector<unsigned char> pixels(NUM_CHARS * CELL_WIDTH * FONT_HEIGHT,
+                                          0);
+        const unsigned char *glyphs = font();
+        int texture_width = NUM_CHARS * CELL_WIDTH;
+        for (int g = 0; g < NUM_CHARS; g++) {
+            for (int c = 0; c < 5; c++) {
+                for (int r = 0; r < 7; r++) {
+                    if (glyphs[g * 5 + c] & (1 << r)) {
+                        pixels[r * texture_width + g * CELL_WIDTH + c] = 255;
+                    }
+                }
+            }
+        }
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, texture_width, FONT_HEIGHT, 0,
+                     GL_RED, GL_UNSIGNED_BYTE, &pixels[0]);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        if (!program.init("#version 150 core\n"
+                          "in vec2 position;\n"
+                          "in vec2 uv;\n"
+                          "out vec2 f_uv;\n"
+                          "void main() {\n"
+                          "    f_uv = uv;\n"
+                          "    gl_Position = vec4(position, 0.0, 1.0);\n"
+                          "}\n",
+                          "#version 150 core\n"
+                          "in vec2 f_uv;\n"
+                          "out vec4 color;\n"
+                          "uniform sampler2D glyphs;\n"
+                          "void main() {\n"
+                          "    float ink = texture(glyphs, f_uv).r;\n"
+                          "    color = mix(vec4(0.0, 0.0, 0.0, 0.6),\n"
+                          "                vec4(1.0, 1.0, 0.6, 1.0), ink);\n"
+                          "}\n",
+                          "", "color")) {
+            return false;
+        }
+
+        VAO.init();
+        VAO.bind();
+        glGenBuffers(1, &vertex_buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+        GLsizei stride = 4 * sizeof(float);
+        GLint position = program.attrib("position");
+        glEnableVertexAttribArray(position);
+        glVertexAttribPointer(position, 2, GL_FLOAT, GL_FALSE, stride,
+                              (void *)0);
+        GLint uv = program.attrib("uv");
+        glEnableVertexAttribArray(uv);
+        glVertexAttribPointer(uv, 2, GL_FLOAT, GL_FALSE, stride,
+                              (void *)(2 * sizeof(float)));
+        glBindVertexArray(0);
+        return true;
+    }
+
+    void clear() { lines.clear(); }
+    void addLine(const std::string &line) { lines.push_back(line); }
+
+    // Draws the lines into the bound framebuffer of width x height pixels
+    void draw(int width, int height) {
+        if (lines.empty() || texture == 0) {
+            return;
+        }
+        size_t longest = 0;
+        for (const std::string &line : lines) {
+            longest = std::max(longest, line.size());
+        }
+        vertices.clear();
+        for (size_t row = 0; row < lines.size(); row++) {
+            // Pad every line to the longest, for an even background
+            for (size_t col = 0; col < longest; col++) {
+                char c = col < lines[row].size() ? lines[row][col] : ' ';
+                addQuad((int)col, (int)row, c, width, height);
+            }
+        }
+
+        program.bind();
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glUniform1i(program.uniform("glyphs"), 0);
+        VAO.bind();
+        glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float),
+                     &vertices[0], GL_STREAM_DRAW);
+
+        glDisable(GL_DEPTH_TEST);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glDrawArrays(GL_TRIANGLES, 0, (GLsizei)(vertices.size() / 4));
+        glDisable(GL_BLEND);
+        glEnable(GL_DEPTH_TEST);
+        glBindVertexArray(0);
+    }
+
+    void free() {
+        if (texture != 0) {
+            glDeleteTextures(1, &texture);
+            glDeleteBuffers(1, &vertex_buffer);
+            VAO.free();
+            program.free();
+            texture = 0;
+        }
+    }
+};
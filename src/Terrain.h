@@ -0,0 +1,437 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <JobSystem.h>
+#include <HeightfieldMesh.h>
+#include <Profiler.h>
+#include <SceneObjectList.h>
+#include <TerrainLod.h>
+
+// A scene object that shows one world grid cell of terrain
+struct TerrainTile {
+    enum STATES {
+        RESIDENT = 0,   // drawn, nothing in flight
+        GENERATING = 1, // staging mesh is being built on a worker
+        READY = 2       // staging mesh is built and waiting for upload
+    };
+    int state = RESIDENT;
+    bool has_cell = false;                  // false until the first upload
+    glm::ivec2 cell = glm::ivec2(0);        // cell currently drawn
+    glm::ivec2 target_cell = glm::ivec2(0); // cell the staging mesh is for
+    int scene_object_idx = -1;
+    HeightfieldMesh *mesh = nullptr;    // geometry being drawn
+    HeightfieldMesh *staging = nullptr; // geometry being generated off-thread
+    JobHandle job;
+    TileLod lod; // picked each frame by selectLod()
+};
+
+// Worker time spent building tile meshes, since the streamer started
+struct TileBuildStats {
+    unsigned long built = 0;
+    double total_ms = 0.0;
+    double max_ms = 0.0;
+};
+
+/*
+    Streams a (2 * radius + 1)^2 neighbourhood of unique terrain tiles
+    around the player.
+
+    Tiles form a toroidal ring: with side = 2 * radius + 1, tile i sits in
+    ring slot (i % side, i / side) and always shows the in-range cell whose
+    coordinates are congruent to that slot mod side. When the player crosses
+    a tile boundary only the row or column of slots whose cell left the
+    range is re-targeted, O(radius) work instead of a search over every
+    tile.
+
+    Every cell gets its own heightfield sampled from world-space noise, so
+    the world no longer repeats. Each tile is double buffered: the drawn mesh
+    stays on screen while its staging mesh is rebuilt for the new cell on
+    the job system. The GL thread then uploads finished tiles under a
+    per-frame time budget and swaps them in, so crossing a tile boundary
+    never stalls a frame on generation.
+*/
+class TerrainStreamer {
+  private:
+    std::mutex mutex; // guards tile states and cells
+    std::vector<TerrainTile> tiles;
+    // Owns the drawn and staging mesh of every tile
+    std::vector<std::unique_ptr<HeightfieldMesh>> tile_meshes;
+    HeightfieldPool pool; // GPU heights and slopes, one slot per tile mesh
+    unsigned int tile_w;
+    unsigned int tile_h;
+    int radius;
+    int mesh_id;
+    glm::ivec2 last_center;
+    bool has_center = false;
+    std::vector<int> stale_slots; // slots whose cell may be out of date
+    std::vector<int> object_tiles; // tile index of each scene object, or -1
+    TileBuildStats build_stats;
+    JobSystem *jobs;
+    void (*height_tile_callback)(glm::ivec2 grid_origin, unsigned int w,
+                                 unsigned int h, float *out);
+    void (*slope_tile_callback)(glm::ivec2 grid_origin, unsigned int w,
+                                unsigned int h, float *slopes);
+
+    int side() { return 2 * radius + 1; }
+
+    static uint64_t cellKey(glm::ivec2 cell) {
+        return ((uint64_t)(uint32_t)cell.x << 32) | (uint32_t)cell.y;
+    }
+
+    // a mod side, in [0, side)
+    int wrap(int a) { return ((a % side()) + side()) % side(); }
+
+    // Cell ring slot idx should show around center
+    glm::ivec2 ringCell(int idx, glm::ivec2 center) {
+        glm::ivec2 lo = center - glm::ivec2(radius);
+        return lo + glm::ivec2(wrap(idx % side() - lo.x),
+                               wrap(idx / side() - lo.y));
+    }
+
+    // Called with mutex held. Queues the slots of every row and column that
+    // entered the range when moving from last_center to center.
+    void markEntered(glm::ivec2 center) {
+        glm::ivec2 delta = center - last_center;
+        if (std::abs(delta.x) >= side() || std::abs(delta.y) >= side()) {
+            for (size_t i = 0; i < tiles.size(); i++) {
+                stale_slots.push_back((int)i);
+            }
+            return;
+        }
+        int step_x = delta.x > 0 ? 1 : -1;
+        for (int k = 1; k <= std::abs(delta.x); k++) {
+            int sx = wrap(last_center.x + step_x * (radius + k));
+            for (int sy = 0; sy < side(); sy++) {
+                stale_slots.push_back(sy * side() + sx);
+            }
+        }
+        int step_y = delta.y > 0 ? 1 : -1;
+        for (int k = 1; k <= std::abs(delta.y); k++) {
+            int sy = wrap(last_center.y + step_y * (radius + k));
+            for (int sx = 0; sx < side(); sx++) {
+                stale_slots.push_back(sy * side() + sx);
+            }
+        }
+    }
+
+    // Cell a tile will show once in-flight work lands
+    glm::ivec2 destinationCell(const TerrainTile &tile) {
+        return tile.state == TerrainTile::RESIDENT ? tile.cell
+                                                   : tile.target_cell;
+    }
+
+    bool hasDestination(const TerrainTile &tile) {
+        return tile.has_cell || tile.state != TerrainTile::RESIDENT;
+    }
+
+    HeightfieldMesh *createTileMesh() {
+        tile_meshes.emplace_back(new HeightfieldMesh(
+            mesh_id, tile_w, tile_h, height_tile_callback, slope_tile_callback,
+            glm::ivec2(0, 0), &pool, tile_meshes.size()));
+        return tile_meshes.back().get();
+    }
+
+    // Called with mutex held. Returns the build, already submitted when
+    // there is a job system; otherwise the caller runs it once it has let go
+    // of the mutex, which the build takes to publish the tile.
+    std::function<void()> generate(int idx, glm::ivec2 cell) {
+        TerrainTile &tile = tiles[idx];
+        tile.target_cell = cell;
+        tile.state = TerrainTile::GENERATING;
+        HeightfieldMesh *staging = tile.staging;
+        staging->grid_origin =
+            glm::ivec2(cell.x * (int)(tile_w - 1), cell.y * (int)(tile_h - 1));
+
+        auto build = [this, idx, staging] {
+            ProfileZone zone("buildTile");
+            auto t_start = std::chrono::high_resolution_clock::now();
+            staging->build();
+            double ms = std::chrono::duration<double, std::milli>(
+                            std::chrono::high_resolution_clock::now() - t_start)
+                            .count();
+            std::lock_guard<std::mutex> lock(mutex);
+            tiles[idx].state = TerrainTile::READY;
+            build_stats.built++;
+            build_stats.total_ms += ms;
+            build_stats.max_ms = std::max(build_stats.max_ms, ms);
+        };
+        if (jobs != nullptr) {
+            tile.job = jobs->submit(build);
+            return nullptr;
+        }
+        return build;
+    }
+
+    // Called with mutex held, by update()
+    void retarget(glm::ivec2 center,
+                  std::vector<std::function<void()>> &builds) {
+        if (has_center) {
+            markEntered(center);
+        }
+        last_center = center;
+        has_center = true;
+
+        // A slot can be queued by both its row and its column
+        std::sort(stale_slots.begin(), stale_slots.end());
+        stale_slots.erase(std::unique(stale_slots.begin(), stale_slots.end()),
+                          stale_slots.end());
+
+        std::vector<int> busy;
+        for (int idx : stale_slots) {
+            TerrainTile &tile = tiles[idx];
+            glm::ivec2 cell = ringCell(idx, center);
+            if (hasDestination(tile) && destinationCell(tile) == cell) {
+                continue;
+            }
+            if (tile.state != TerrainTile::RESIDENT) {
+                busy.push_back(idx);
+                continue;
+            }
+            std::function<void()> build = generate(idx, cell);
+            if (build) {
+                builds.push_back(build);
+            }
+        }
+        stale_slots.swap(busy);
+    }
+
+  public:
+    TerrainStreamer(unsigned int _tile_w, unsigned int _tile_h, int _radius,
+                    int _mesh_id,
+                    void (*_height_tile_callback)(glm::ivec2 grid_origin,
+                                                  unsigned int w,
+                                                  unsigned int h, float *out),
+                    void (*_slope_tile_callback)(glm::ivec2 grid_origin,
+                                                 unsigned int w,
+                                                 unsigned int h,
+                                                 float *slopes),
+                    JobSystem *_jobs) {
+        tile_w = _tile_w;
+        tile_h = _tile_h;
+        radius = _radius;
+        mesh_id = _mesh_id;
+        height_tile_callback = _height_tile_callback;
+        slope_tile_callback = _slope_tile_callback;
+        jobs = _jobs;
+    }
+
+    int numTiles() { return (2 * radius + 1) * (2 * radius + 1); }
+
+    // Where the tile meshes keep their GPU heights and slopes
+    HeightfieldPool &vertexPool() { return pool; }
+
+    // Size of a tile in world units (tiles share their edge vertices)
+    glm::vec2 tileSpan() { return glm::vec2(tile_w - 1, tile_h - 1); }
+
+    // Registers the scene object that will draw the next ring slot
+    void addTile(int scene_object_idx) {
+        std::lock_guard<std::mutex> lock(mutex);
+        TerrainTile tile;
+        tile.scene_object_idx = scene_object_idx;
+        tile.mesh = createTileMesh();
+        tile.staging = createTileMesh();
+        stale_slots.push_back((int)tiles.size());
+        if ((int)object_tiles.size() <= scene_object_idx) {
+            object_tiles.resize(scene_object_idx + 1, -1);
+        }
+        object_tiles[scene_object_idx] = (int)tiles.size();
+        tiles.push_back(tile);
+    }
+
+    // Re-targets the ring slots whose cell fell out of range around
+    // `center`. Slots still busy with an older cell are retried on the next
+    // call. Safe to call from any thread.
+    void update(glm::ivec2 center) {
+        std::vector<std::function<void()>> builds; // without a job system
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            retarget(center, builds);
+        }
+        for (std::function<void()> &build : builds) {
+            build();
+        }
+    }
+
+    // GL thread only. Picks the coarsest LOD level of every drawn tile whose
+    // geometric error projects to at most tolerance_px pixels, keeps
+    // neighbours within one level and works out the stitched edges.
+    // pixel_scale is the projection's pixels per world unit at distance 1;
+    // orthographic views don't shrink with distance.
+    void selectLod(TerrainLod &lod, glm::vec3 eye, float pixel_scale,
+                   bool is_perspective, float tolerance_px) {
+        std::lock_guard<std::mutex> lock(mutex);
+        glm::vec2 span = tileSpan();
+        int max_level = lod.numLevels() - 1;
+        std::unordered_map<uint64_t, int> by_cell;
+        for (size_t i = 0; i < tiles.size(); i++) {
+            TerrainTile &tile = tiles[i];
+            tile.lod = TileLod();
+            if (!tile.has_cell || tolerance_px <= 0.0f) {
+                continue;
+            }
+            by_cell[cellKey(tile.cell)] = (int)i;
+
+            HeightfieldMesh *m = tile.mesh;
+            glm::vec3 center =
+                glm::vec3(tile.cell.x * span.x, 0.0f, tile.cell.y * span.y) +
+                m->center;
+            float dist = glm::max(glm::distance(eye, center) - m->mesh_radius,
+                                  1.0f);
+            float px_per_unit = is_perspective ? pixel_scale / dist
+                                               : pixel_scale;
+            int level = 0;
+            while (level < max_level &&
+                   m->lod_errors[level + 1] * px_per_unit <= tolerance_px) {
+                level++;
+            }
+            tile.lod.level = level;
+            // Fade towards the next level over the last 2x of error
+            if (level < max_level) {
+                float t = m->lod_errors[level + 1] * px_per_unit /
+                          tolerance_px;
+                tile.lod.morph = glm::clamp(2.0f - t, 0.0f, 1.0f);
+            }
+        }
+
+        // Neighbours differ by at most one level. Tiles pulled finer keep
+        // morphing fully towards the level they wanted.
+        const glm::ivec2 dirs[4] = {glm::ivec2(0, -1), glm::ivec2(0, 1),
+                                    glm::ivec2(-1, 0), glm::ivec2(1, 0)};
+        const int edges[4] = {TerrainLod::EDGE_NORTH, TerrainLod::EDGE_SOUTH,
+                              TerrainLod::EDGE_WEST, TerrainLod::EDGE_EAST};
+        bool is_changed = true;
+        while (is_changed) {
+            is_changed = false;
+            for (TerrainTile &tile : tiles) {
+                if (!tile.has_cell) {
+                    continue;
+                }
+                for (int d = 0; d < 4; d++) {
+                    auto it = by_cell.find(cellKey(tile.cell + dirs[d]));
+                    if (it == by_cell.end()) {
+                        continue;
+                    }
+                    int limit = tiles[it->second].lod.level + 1;
+                    if (tile.lod.level > limit) {
+                        tile.lod.level = limit;
+                        tile.lod.morph = 1.0f;
+                        is_changed = true;
+                    }
+                }
+            }
+        }
+
+        for (TerrainTile &tile : tiles) {
+            if (!tile.has_cell) {
+                continue;
+            }
+            for (int d = 0; d < 4; d++) {
+                auto it = by_cell.find(cellKey(tile.cell + dirs[d]));
+                if (it != by_cell.end() &&
+                    tiles[it->second].lod.level > tile.lod.level) {
+                    tile.lod.stitch_mask |= edges[d];
+                }
+            }
+        }
+    }
+
+    // LOD picked for the tile drawn by a scene object
+    TileLod tileLod(int scene_object_idx) {
+        if (scene_object_idx >= (int)object_tiles.size() ||
+            object_tiles[scene_object_idx] < 0) {
+            return TileLod();
+        }
+        return tiles[object_tiles[scene_object_idx]].lod;
+    }
+
+    // Blocks until every in-flight tile has been generated
+    void finish() {
+        std::vector<JobHandle> pending;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (TerrainTile &tile : tiles) {
+                if (tile.job) {
+                    pending.push_back(tile.job);
+                }
+            }
+        }
+        for (JobHandle &job : pending) {
+            jobs->wait(job);
+        }
+    }
+
+    // GL thread only. Uploads generated tiles and swaps them in until
+    // budget_ms has been spent (at least one tile per call, so streaming
+    // always makes progress). A negative budget uploads everything.
+    int uploadReady(SceneObjectList &scene_objects, double budget_ms) {
+        ProfileZone zone("uploadTiles");
+        auto t_start = std::chrono::high_resolution_clock::now();
+        int uploaded = 0;
+        if (!pool.isInit()) {
+            pool.init(tile_w, tile_h, tile_meshes.size());
+        }
+        for (TerrainTile &tile : tiles) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (tile.state != TerrainTile::READY) {
+                    continue;
+                }
+            }
+
+            // Workers are done with the staging mesh once it is READY
+            tile.staging->uploadBuffers();
+            std::swap(tile.mesh, tile.staging);
+
+            SceneObject *so = scene_objects.at(tile.scene_object_idx);
+            glm::vec2 span = tileSpan();
+            so->mesh = tile.mesh;
+            so->translation = glm::vec3(tile.target_cell.x * span.x, 0.0f,
+                                        tile.target_cell.y * span.y);
+            so->updateModel();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                tile.cell = tile.target_cell;
+                tile.has_cell = true;
+                tile.state = TerrainTile::RESIDENT;
+                tile.job = nullptr;
+            }
+            uploaded++;
+
+            auto t_now = std::chrono::high_resolution_clock::now();
+            double elapsed_ms =
+                std::chrono::duration<double, std::milli>(t_now - t_start)
+                    .count();
+            if (budget_ms >= 0.0 && elapsed_ms >= budget_ms) {
+                break;
+            }
+        }
+        return uploaded;
+    }
+
+    // Tiles drawn with nothing in flight
+    int residentTiles() {
+        std::lock_guard<std::mutex> lock(mutex);
+        int resident = 0;
+        for (const TerrainTile &tile : tiles) {
+            if (tile.has_cell && tile.state == TerrainTile::RESIDENT) {
+                resident++;
+            }
+        }
+        return resident;
+    }
+
+    TileBuildStats buildStats() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return build_stats;
+    }
+};
@@ -0,0 +1,293 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "lib/Helpers.h"
+#include <DrawStats.h>
+
+/*
+    Geometry clipmap terrain, an alternative to streaming whole tiles.
+
+    Nested square grids of size x size vertices stay centered on the viewer;
+    level L spaces its vertices 2^L world units apart, so the clipmap reaches
+    (size - 1) * 2^(levels - 1) units across with a fixed vertex count.
+
+    Each level keeps its heights and slopes in one layer of a pair of 2D array
+    textures, addressed toroidally: level grid point g lives at texel
+    g mod size. When the viewer moves, only the rows and columns scrolling
+    into a level (an L-shaped strip) are sampled and uploaded, so memory and
+    per-frame work stay constant whatever the view distance.
+
+    Every level draws the same vertex grid, positions coming from
+    gl_VertexID and the level's origin. Level 0 is a full grid; coarser levels
+    leave out the hole covered by the next finer level, which sits one of
+    4 ways inside them. Towards its border each level blends into the surface
+    of the next coarser one in the vertex shader, so no cracks open between
+    levels.
+
+    All methods but the constructor touch GL state and must run on the GL
+    thread.
+*/
+class TerrainClipmap {
+  public:
+    // Fills the heights and (dh/dx, dh/dz) slope pairs of n samples at
+    // world (xs[i], z), both in world units
+    typedef void (*RowCallback)(const float *xs, float z, unsigned int n,
+                                float *heights, float *slopes);
+
+  private:
+    int size;   // vertices per level row and column, 4k + 3
+    int levels; // level L is spaced 2^L world units
+    RowCallback row_callback;
+    std::vector<glm::ivec2> origins; // level grid coords of vertex 0
+    std::vector<glm::ivec2> holes;   // cell offset of the finer level in it
+    bool has_origins = false;
+    GLuint textures[2] = {0, 0}; // heights, slopes
+    IndexBufferObject index_buffer; // 16-bit while size * size allows
+    VertexArrayObject VAO;
+    std::vector<unsigned int> indices; // full grid, then the 4 holed grids
+    size_t first[5];
+    unsigned int count[5];
+    std::vector<float> strip_heights; // scratch for refresh()
+    std::vector<float> strip_slopes;
+    std::vector<float> strip_xs;
+
+    // Cells of a level covered by the next finer level
+    int holeCells() { return (size - 1) / 2; }
+
+    // Smallest hole offset; the hole sits at this or one cell further
+    int holeMin() { return (holeCells() - 1) / 2; }
+
+    static int wrap(int g, int n) { return ((g % n) + n) % n; }
+
+    // Triangle list over the grid, skipping the cells of the hole at
+    // (hole_x, hole_z) when hole_x >= 0. Same winding and diagonal as
+    // HeightfieldMesh::gridIndices(), which the shader's blend relies on.
+    void pushGrid(int hole_x, int hole_z) {
+        int hole = holeCells();
+        for (int r = 0; r < size - 1; r++) {
+            for (int c = 0; c < size - 1; c++) {
+                if (hole_x >= 0 && c >= hole_x && c < hole_x + hole &&
+                    r >= hole_z && r < hole_z + hole) {
+                    continue;
+                }
+                indices.push_back(r * size + c);
+                indices.push_back((r + 1) * size + c);
+                indices.push_back(r * size + c + 1);
+                indices.push_back((r + 1) * size + c);
+                indices.push_back((r + 1) * size + c + 1);
+                indices.push_back(r * size + c + 1);
+            }
+        }
+    }
+
+    // Index set drawn by level
+    int indexSet(int level) {
+        if (level == 0) {
+            return 0;
+        }
+        glm::ivec2 k = holes[level] - holeMin();
+        return 1 + k.x + 2 * k.y;
+    }
+
+    // Places every level around the viewer, coarsest first. Each finer
+    // level snaps onto its coarser level's grid (so its border vertices
+    // are coarse vertices or midpoints of coarse edges) and is offset by
+    // one of two cells per axis, whichever centers it best.
+    void place(glm::vec3 viewer, std::vector<glm::ivec2> &next_origins,
+               std::vector<glm::ivec2> &next_holes) {
+        glm::vec2 p(viewer.x, viewer.z);
+        int half = holeCells();
+        next_origins.assign(levels, glm::ivec2(0));
+        next_holes.assign(levels, glm::ivec2(holeMin()));
+        for (int l = levels - 1; l >= 0; l--) {
+            glm::vec2 ideal = p / (float)(1 << l) - (float)half;
+            if (l == levels - 1) {
+                next_origins[l] = glm::ivec2(glm::floor(ideal + 0.5f));
+                continue;
+            }
+            glm::ivec2 coarse = next_origins[l + 1];
+            glm::ivec2 k(glm::floor(ideal * 0.5f - glm::vec2(coarse) + 0.5f));
+            k = glm::clamp(k, glm::ivec2(holeMin()), glm::ivec2(holeMin() + 1));
+            next_holes[l + 1] = k;
+            next_origins[l] = (coarse + k) * 2;
+        }
+    }
+
+    // Samples the w x h level grid points from g0 and uploads them to their
+    // toroidal texels, splitting the rectangle where it wraps around
+    unsigned int refresh(int level, glm::ivec2 g0, int w, int h) {
+        if (w <= 0 || h <= 0) {
+            return 0;
+        }
+        float spacing = (float)(1 << level);
+        strip_xs.resize(w);
+        strip_heights.resize(w * h);
+        strip_slopes.resize(w * h * 2);
+        for (int i = 0; i < w; i++) {
+            strip_xs[i] = (g0.x + i) * spacing;
+        }
+        for (int j = 0; j < h; j++) {
+            row_callback(&strip_xs[0], (g0.y + j) * spacing, w,
+                         &strip_heights[j * w], &strip_slopes[j * w * 2]);
+        }
+
+        int tx = wrap(g0.x, size);
+        int tz = wrap(g0.y, size);
+        int w0 = std::min(w, size - tx);
+        int h0 = std::min(h, size - tz);
+        // (texel, first sample, samples) along each axis
+        const int xs[2][3] = {{tx, 0, w0}, {0, w0, w - w0}};
+        const int zs[2][3] = {{tz, 0, h0}, {0, h0, h - h0}};
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, w);
+        for (int zi = 0; zi < 2; zi++) {
+            for (int xi = 0; xi < 2; xi++) {
+                if (xs[xi][2] == 0 || zs[zi][2] == 0) {
+                    continue;
+                }
+                glPixelStorei(GL_UNPACK_SKIP_PIXELS, xs[xi][1]);
+                glPixelStorei(GL_UNPACK_SKIP_ROWS, zs[zi][1]);
+                glBindTexture(GL_TEXTURE_2D_ARRAY, textures[0]);
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, xs[xi][0], zs[zi][0],
+                                level, xs[xi][2], zs[zi][2], 1, GL_RED,
+                                GL_FLOAT, &strip_heights[0]);
+                glBindTexture(GL_TEXTURE_2D_ARRAY, textures[1]);
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, xs[xi][0], zs[zi][0],
+                                level, xs[xi][2], zs[zi][2], 1, GL_RG,
+                                GL_FLOAT, &strip_slopes[0]);
+            }
+        }
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+        glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        return w * h;
+    }
+
+  public:
+    TerrainClipmap(int _size, int _levels, RowCallback _row_callback) {
+        assert(_size >= 7 && _size % 4 == 3);
+        size = _size;
+        levels = std::max(1, _levels);
+        row_callback = _row_callback;
+        first[0] = 0;
+        pushGrid(-1, -1);
+        count[0] = indices.size();
+        for (int i = 0; i < 4; i++) {
+            first[i + 1] = indices.size();
+            pushGrid(holeMin() + i % 2, holeMin() + i / 2);
+            count[i + 1] = indices.size() - first[i + 1];
+        }
+    }
+
+    int numLevels() { return levels; }
+
+    // World units covered by the coarsest level
+    int extent() { return (size - 1) << (levels - 1); }
+
+    // GPU memory of the height and slope textures
+    size_t gpuBytes() {
+        return (size_t)size * size * levels * 3 * sizeof(float);
+    }
+
+    void init() {
+        glGenTextures(2, textures);
+        const GLint formats[2] = {GL_R32F, GL_RG32F};
+        const GLenum channels[2] = {GL_RED, GL_RG};
+        for (int i = 0; i < 2; i++) {
+            glBindTexture(GL_TEXTURE_2D_ARRAY, textures[i]);
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, formats[i], size, size,
+                         levels, 0, channels[i], GL_FLOAT, nullptr);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                            GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER,
+                            GL_NEAREST);
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        index_buffer.init();
+        index_buffer.update(&indices[0], indices.size(), size * size);
+        VAO.init(); // empty, but core profile draws need one bound
+
+        std::cout << "Clipmap: " << levels << " levels of " << size << "x"
+                  << size << ", " << extent() << " units across, "
+                  << gpuBytes() / 1024 << " KB" << std::endl;
+    }
+
+    // Re-centers every level on the viewer, sampling only the grid points
+    // that scrolled in. Returns the number of points sampled.
+    unsigned int update(glm::vec3 viewer) {
+        std::vector<glm::ivec2> next_origins;
+        place(viewer, next_origins, holes);
+        unsigned int sampled = 0;
+        for (int l = 0; l < levels; l++) {
+            glm::ivec2 o = next_origins[l];
+            glm::ivec2 d = has_origins ? o - origins[l] : glm::ivec2(size);
+            if (std::abs(d.x) >= size || std::abs(d.y) >= size) {
+                sampled += refresh(l, o, size, size);
+                continue;
+            }
+            // Rows that scrolled in, full width
+            int rows = std::abs(d.y);
+            int row0 = d.y > 0 ? o.y + size - rows : o.y;
+            sampled += refresh(l, glm::ivec2(o.x, row0), size, rows);
+            // Columns that scrolled in, minus the rows just done
+            int cols = std::abs(d.x);
+            int col0 = d.x > 0 ? o.x + size - cols : o.x;
+            int kept0 = d.y > 0 ? o.y : o.y + rows;
+            sampled += refresh(l, glm::ivec2(col0, kept0), cols, size - rows);
+        }
+        origins = next_origins;
+        has_origins = true;
+        return sampled;
+    }
+
+    // Draws every level; heights and slopes go to texture units unit and
+    // unit + 1. Expects the program bound with the clipmap's meshID set.
+    void draw(Program &program, int unit, DrawStats *stats = nullptr) {
+        const char *names[2] = {"clipmapHeights", "clipmapSlopes"};
+        for (int i = 0; i < 2; i++) {
+            glActiveTexture(GL_TEXTURE0 + unit + i);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, textures[i]);
+            glUniform1i(program.uniform(names[i]), unit + i);
+        }
+        glActiveTexture(GL_TEXTURE0);
+
+        VAO.bind();
+        index_buffer.bind();
+        glUniform1i(program.uniform("clipmapSize"), size);
+        for (int l = 0; l < levels; l++) {
+            glm::ivec2 o = origins[l];
+            glUniform2i(program.uniform("clipmapOrigin"), o.x, o.y);
+            glUniform2i(program.uniform("clipmapWrap"), wrap(o.x, size),
+                        wrap(o.y, size));
+            glUniform1i(program.uniform("clipmapScale"), 1 << l);
+            glUniform1i(program.uniform("clipmapLevel"), l);
+            // The coarsest level has nothing to blend into
+            glUniform1f(program.uniform("clipmapMorph"),
+                        l < levels - 1 ? 1.0f : 0.0f);
+            int set = indexSet(l);
+            glDrawElements(GL_TRIANGLES, count[set], index_buffer.type,
+                           index_buffer.offset(first[set]));
+            if (stats != nullptr) {
+                stats->add(count[set]);
+            }
+        }
+    }
+
+    void free() {
+        glDeleteTextures(2, textures);
+        textures[0] = textures[1] = 0;
+        if (index_buffer.id != 0) {
+            index_buffer.free();
+        }
+        VAO.free();
+        has_origins = false;
+    }
+};
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include <HeightfieldMesh.h>
+
+// How a terrain tile is drawn this frame
+struct TileLod {
+    int level = 0;       // keeps every 2^level-th row and column
+    int stitch_mask = 0; // TerrainLod::EDGE_* bits facing a coarser tile
+    float morph = 0.0f;  // 0..1 blend of interior heights towards level + 1
+};
+
+/*
+    Geomipmapped index sets for w x h terrain tiles.
+
+    Every tile keeps its full resolution heights on the GPU; a LOD level is
+    just a different index range into one shared element buffer, so
+    switching levels costs nothing. Each level comes in 16 variants, one per
+    combination of edges that border a tile one level coarser. On those
+    edges every vertex the coarser tile doesn't have is snapped onto its
+    preceding coarse vertex, so both sides of the seam share the same edge
+    segments and no cracks open. Neighbouring tiles are kept within one
+    level of each other (see TerrainStreamer::selectLod()).
+
+    Interior vertices can additionally be morphed towards the next level in
+    the vertex shader; edge vertices never morph, which keeps seams closed
+    while a tile fades between levels.
+*/
+class TerrainLod {
+  public:
+    enum EDGES {
+        EDGE_NORTH = 1, // row 0, borders cell (x, y - 1)
+        EDGE_SOUTH = 2, // last row, borders cell (x, y + 1)
+        EDGE_WEST = 4,  // column 0, borders cell (x - 1, y)
+        EDGE_EAST = 8   // last column, borders cell (x + 1, y)
+    };
+
+  private:
+    unsigned int width;
+    unsigned int height;
+    int levels;
+    vector<unsigned int> indices; // every (level, mask) set back to back
+    vector<size_t> first;         // first index of each set
+    vector<unsigned int> count;   // number of indices of each set
+
+    // Rows or columns kept at step, always including the last one
+    static vector<unsigned int> samples(unsigned int n, unsigned int step) {
+        vector<unsigned int> kept;
+        for (unsigned int i = 0; i < n - 1; i += step) {
+            kept.push_back(i);
+        }
+        kept.push_back(n - 1);
+        return kept;
+    }
+
+    // Moves i onto the grid of the next coarser level if it isn't on it
+    unsigned int snap(unsigned int i, unsigned int n, unsigned int step) {
+        return (i % (step * 2) != 0 && i != n - 1) ? i - step : i;
+    }
+
+    unsigned int vertex(unsigned int c, unsigned int r, unsigned int step,
+                        int mask) {
+        if ((r == 0 && (mask & EDGE_NORTH)) ||
+            (r == height - 1 && (mask & EDGE_SOUTH))) {
+            c = snap(c, width, step);
+        }
+        if ((c == 0 && (mask & EDGE_WEST)) ||
+            (c == width - 1 && (mask & EDGE_EAST))) {
+            r = snap(r, height, step);
+        }
+        return r * width + c;
+    }
+
+    // Twice the signed area of triangle abc in the (c, r) plane; negative
+    // for the winding used by gridIndices()
+    long area(unsigned int a, unsigned int b, unsigned int c) {
+        long ax = a % width, ay = a / width;
+        long bx = b % width, by = b / width;
+        long cx = c % width, cy = c / width;
+        return (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+    }
+
+    void pushTriangle(unsigned int a, unsigned int b, unsigned int c) {
+        // Snapping collapses some edge triangles
+        if (a == b || b == c || a == c) {
+            return;
+        }
+        indices.push_back(a);
+        indices.push_back(b);
+        indices.push_back(c);
+    }
+
+    // Quad with corners a = (c0, r0), b = (c0, r1), c = (c1, r1),
+    // d = (c1, r0) after snapping
+    void pushQuad(unsigned int a, unsigned int b, unsigned int c,
+                  unsigned int d) {
+        // Same winding and diagonal as gridIndices(), unless snapping both
+        // ends of that diagonal outwards (in a stitched corner) folds or
+        // flattens it
+        if (area(a, b, d) >= 0 || area(b, c, d) >= 0) {
+            pushTriangle(a, b, c);
+            pushTriangle(a, c, d);
+            return;
+        }
+        pushTriangle(a, b, d);
+        pushTriangle(b, c, d);
+    }
+
+  public:
+    TerrainLod(unsigned int _width, unsigned int _height) {
+        width = _width;
+        height = _height;
+        levels = HeightfieldMesh::lodLevels(width, height);
+        for (int level = 0; level < levels; level++) {
+            unsigned int step = 1 << level;
+            vector<unsigned int> cols = samples(width, step);
+            vector<unsigned int> rows = samples(height, step);
+            for (int mask = 0; mask < 16; mask++) {
+                // Nothing is coarser than the last level
+                if (mask > 0 && level == levels - 1) {
+                    first.push_back(first.back());
+                    count.push_back(count.back());
+                    continue;
+                }
+                first.push_back(indices.size());
+                for (size_t y = 0; y + 1 < rows.size(); y++) {
+                    for (size_t x = 0; x + 1 < cols.size(); x++) {
+                        unsigned int c0 = cols[x], c1 = cols[x + 1];
+                        unsigned int r0 = rows[y], r1 = rows[y + 1];
+                        pushQuad(vertex(c0, r0, step, mask),
+                                 vertex(c0, r1, step, mask),
+                                 vertex(c1, r1, step, mask),
+                                 vertex(c1, r0, step, mask));
+                    }
+                }
+                count.push_back(indices.size() - first.back());
+            }
+        }
+    }
+
+    int numLevels() { return levels; }
+
+    // Index set of a (level, stitch mask) pair
+    static int key(const TileLod &lod) {
+        return lod.level * 16 + lod.stitch_mask;
+    }
+
+    // All index sets, to upload once as the terrain element buffer
+    const vector<unsigned int> &allIndices() { return indices; }
+
+    size_t firstIndex(int key) { return first[key]; }
+
+    unsigned int numIndices(int key) { return count[key]; }
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <JobSystem.h>
+#include <Noise.h>
+
+/*
+    Height and slope tiles of the terrain, as the renderer's height cache
+    and tile builders ask for them. Rows are spread over jobs when given
+    one, else filled on the calling thread.
+
+    Vertices are 1 unit apart and sample the noise at world / tile size, so
+    neighbouring tiles share their edge rows exactly.
+*/
+
+// Fills out with the w x h heights of one world cell, sampled row by row
+inline void terrainHeightCell(const NoiseParams &p, JobSystem *jobs,
+                              glm::ivec2 cell, unsigned int w, unsigned int h,
+                              float *out) {
+    glm::ivec2 origin(cell.x * (int)(w - 1), cell.y * (int)(h - 1));
+    std::vector<float> xs(w);
+    for (unsigned int c = 0; c < w; c++) {
+        xs[c] = (float)(origin.x + (int)c) / w;
+    }
+    auto fillRows = [&](unsigned int r_begin, unsigned int r_end) {
+        for (unsigned int r = r_begin; r < r_end; r++) {
+            float y = (float)(origin.y + (int)r) / h;
+            terrainHeightRow(&xs[0], y, w, p, out + r * w);
+        }
+    };
+    if (jobs != nullptr) {
+        jobs->parallelFor(0, h, 8, fillRows);
+    } else {
+        fillRows(0, h);
+    }
+}
+
+// Slope of every vertex of a tile in world units, from the analytic noise
+// derivatives (hence the 1 / w and 1 / h). Written as interleaved
+// (dh/dx, dh/dz) pairs, the layout of the slope vertex stream.
+inline void terrainSlopeTile(const NoiseParams &p, JobSystem *jobs,
+                             glm::ivec2 grid_origin, unsigned int w,
+                             unsigned int h, float *slopes) {
+    std::vector<float> xs(w);
+    for (unsigned int c = 0; c < w; c++) {
+        xs[c] = (float)(grid_origin.x + (int)c) / w;
+    }
+    auto fillRows = [&](unsigned int r_begin, unsigned int r_end) {
+        std::vector<float> heights(w);
+        std::vector<float> row_dx(w);
+        std::vector<float> row_dz(w);
+        for (unsigned int r = r_begin; r < r_end; r++) {
+            float y = (float)(grid_origin.y + (int)r) / h;
+            terrainHeightRowD(&xs[0], y, w, p, &heights[0], &row_dx[0],
+                              &row_dz[0]);
+            float *row = slopes + r * w * 2;
+            for (unsigned int c = 0; c < w; c++) {
+                row[c * 2] = row_dx[c] / w;
+                row[c * 2 + 1] = row_dz[c] / h;
+            }
+        }
+    };
+    if (jobs != nullptr) {
+        jobs->parallelFor(0, h, 8, fillRows);
+    } else {
+        fillRows(0, h);
+    }
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+/*
+    Locale-free number scanning over a [p, end) character range, in the
+    spirit of std::from_chars (which needs C++17 and, for floats, a recent
+    standard library). Each scan* function skips leading blanks, parses one
+    value, advances p past it and returns false (leaving p alone) when no
+    number starts there. No terminator is needed, so they run straight over
+    memory-mapped files, and nothing is allocated short of floats over 63
+    characters long. Floats too long for the fast path go through strtod,
+    in the "C" locale the program never changes.
+*/
+namespace text_scan {
+
+inline bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+// Skips spaces and tabs, not newlines
+inline void skipBlanks(const char *&p, const char *end) {
+    while (p < end && isBlank(*p)) {
+        p++;
+    }
+}
+
+// Moves p to the first character of the next line
+inline void skipLine(const char *&p, const char *end) {
+    while (p < end && *p != '\n') {
+        p++;
+    }
+    if (p < end) {
+        p++;
+    }
+}
+
+// Values past the range of long saturate to LONG_MIN / LONG_MAX, with all
+// their digits consumed
+inline bool scanInt(const char *&p, const char *end, long &out) {
+    const char *s = p;
+    skipBlanks(s, end);
+    bool is_negative = false;
+    if (s < end && (*s == '-' || *s == '+')) {
+        is_negative = *s == '-';
+        s++;
+    }
+    if (s == end || !isDigit(*s)) {
+        return false;
+    }
+    // Magnitude in unsigned arithmetic, so -LONG_MIN still fits
+    unsigned long limit =
+        is_negative ? (unsigned long)LONG_MAX + 1 : (unsigned long)LONG_MAX;
+    unsigned long value = 0;
+    while (s < end && isDigit(*s)) {
+        unsigned long digit = *s - '0';
+        value = value > (limit - digit) / 10 ? limit : value * 10 + digit;
+        s++;
+    }
+    if (is_negative) {
+        out = value == limit ? LONG_MIN : -(long)value;
+    } else {
+        out = (long)value;
+    }
+    p = s;
+    return true;
+}
+
+// Saturates to INT_MIN / INT_MAX like the long version
+inline bool scanInt(const char *&p, const char *end, int &out) {
+    long value;
+    if (!scanInt(p, end, value)) {
+        return false;
+    }
+    out = (int)std::max((long)INT_MIN, std::min((long)INT_MAX, value));
+    return true;
+}
+
+// Decimal and scientific notation. Numbers whose significant digits fit
+// exactly in a double (mantissa up to 2^53, so about 15 to 16 digits) and
+// whose power of ten is exact too are scaled directly (Clinger's fast
+// path), which covers the short numbers mesh exporters write. Longer ones
+// are copied out and handed to strtod, so every value is correctly
+// rounded.
+inline bool scanFloat(const char *&p, const char *end, double &out) {
+    static const double POW10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                   1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                   1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                   1e18, 1e19, 1e20, 1e21, 1e22};
+    const char *s = p;
+    skipBlanks(s, end);
+    const char *start = s;
+    bool is_negative = false;
+    if (s < end && (*s == '-' || *s == '+')) {
+        is_negative = *s == '-';
+        s++;
+    }
+    uint64_t mantissa = 0;
+    int digits = 0; // significant digits kept in mantissa
+    int exp10 = 0;
+    bool has_digits = false;
+    bool is_truncated = false; // digits past the 19th were dropped
+    while (s < end && isDigit(*s)) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*s - '0');
+            digits += mantissa != 0;
+        } else {
+            exp10++;
+            is_truncated = is_truncated || *s != '0';
+        }
+        has_digits = true;
+        s++;
+    }
+    if (s < end && *s == '.') {
+        s++;
+        while (s < end && isDigit(*s)) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*s - '0');
+                digits += mantissa != 0;
+                exp10--;
+            } else {
+                is_truncated = is_truncated || *s != '0';
+            }
+            has_digits = true;
+            s++;
+        }
+    }
+    if (!has_digits) {
+        return false;
+    }
+    if (s < end && (*s == 'e' || *s == 'E')) {
+        const char *e = s + 1;
+        long exponent;
+        if (e < end && !isBlank(*e) && scanInt(e, end, exponent)) {
+            exp10 += (int)std::max(-400L, std::min(400L, exponent));
+            s = e;
+        }
+    }
+
+    double value;
+    if (!is_truncated && mantissa <= (1ull << 53) && exp10 >= -22 &&
+        exp10 <= 22) {
+        // Both operands exact, so the one rounding is the correct one
+        value = (double)mantissa;
+        value = exp10 < 0 ? value / POW10[-exp10] : value * POW10[exp10];
+        out = is_negative ? -value : value;
+    } else {
+        // strtod wants a terminated copy; numbers this long are rare
+        char buffer[64];
+        size_t length = s - start;
+        if (length < sizeof(buffer)) {
+            memcpy(buffer, start, length);
+            buffer[length] = '\0';
+            out = strtod(buffer, nullptr);
+        } else {
+            out = strtod(std::string(start, length).c_str(), nullptr);
+        }
+    }
+    p = s;
+    return true;
+}
+
+inline bool scanFloat(const char *&p, const char *end, float &out) {
+    double value;
+    if (!scanFloat(p, end, value)) {
+        return false;
+    }
+    out = (float)value;
+    return true;
+}
+
+} // namespace text_scan
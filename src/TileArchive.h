@@ -0,0 +1,273 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+
+#include <glm/glm.hpp>
+
+#include <Noise.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+    Persistent, memory-mapped store of generated terrain tiles.
+
+    File layout (native endianness):
+
+        [header: 128 bytes]
+        [index:  num_slots x TileArchiveSlot, open addressing on the cell]
+        [payload: capacity x (tile_w * tile_h * 3) floats, page aligned]
+
+    Each tile's payload is its tile_w * tile_h heights followed by the
+    matching (dh/dx, dh/dz) slope pairs, so a tile read back from the
+    archive needs no noise at all.
+
+    The file is sized for `capacity` tiles up front (sparse on most file
+    systems) and mapped once, so pointers returned by find() stay valid until
+    close() and tiles are read straight out of the page cache with no parsing
+    or copying. The header records the noise parameters and seed the tiles
+    were generated with; an archive written with different settings is
+    detected as stale on open() and rebuilt.
+*/
+
+struct TileArchiveHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t tile_w;
+    uint32_t tile_h;
+    uint32_t capacity;  // max number of tiles
+    uint32_t num_slots; // index slots (2x capacity)
+    uint32_t tile_count;
+    uint32_t seed;
+    int32_t octaves;
+    float persistence;
+    float lateral_scaling;
+    float vertical_scaling;
+    float vertical_offset;
+    float min_elevation;
+};
+
+struct TileArchiveSlot {
+    int32_t x;
+    int32_t y;
+    uint32_t tile; // payload index + 1, 0 when the slot is empty
+    uint32_t reserved;
+};
+
+class TileArchive {
+  private:
+    static const uint32_t VERSION = 2; // 2: slopes stored with the heights
+    static const size_t HEADER_BYTES = 128;
+    static const size_t PAGE_BYTES = 4096;
+
+    std::mutex mutex; // guards index updates
+    std::string path;
+    int fd = -1;
+    char *data = nullptr; // start of the mapping
+    size_t mapped_bytes = 0;
+    size_t payload_offset = 0;
+    TileArchiveHeader *header = nullptr;
+    TileArchiveSlot *slots = nullptr;
+    bool is_full_logged = false;
+
+    // Heights, then two slope components per vertex
+    size_t tileFloats() {
+        return (size_t)header->tile_w * header->tile_h * 3;
+    }
+
+    static size_t fileBytes(uint32_t tile_w, uint32_t tile_h,
+                            uint32_t capacity, size_t &payload_offset) {
+        size_t index_bytes = (size_t)capacity * 2 * sizeof(TileArchiveSlot);
+        payload_offset = (HEADER_BYTES + index_bytes + PAGE_BYTES - 1) /
+                         PAGE_BYTES * PAGE_BYTES;
+        return payload_offset +
+               (size_t)capacity * tile_w * tile_h * 3 * sizeof(float);
+    }
+
+    static bool matches(const TileArchiveHeader &h, uint32_t tile_w,
+                        uint32_t tile_h, uint32_t capacity,
+                        const NoiseParams &p) {
+        return memcmp(h.magic, "ITTA", 4) == 0 && h.version == VERSION &&
+               h.tile_w == tile_w && h.tile_h == tile_h &&
+               h.capacity == capacity && h.num_slots == capacity * 2 &&
+               h.seed == p.seed && h.octaves == p.octaves &&
+               h.persistence == p.persistence &&
+               h.lateral_scaling == p.lateral_scaling &&
+               h.vertical_scaling == p.vertical_scaling &&
+               h.vertical_offset == p.vertical_offset &&
+               h.min_elevation == p.min_elevation;
+    }
+
+    // Index slot holding cell, or the empty slot where it would go.
+    // Called with mutex held, or on a read-only lookup.
+    TileArchiveSlot *probe(glm::ivec2 cell) {
+        uint32_t h =
+            (uint32_t)cell.x * 73856093u ^ (uint32_t)cell.y * 19349663u;
+        for (uint32_t i = 0; i < header->num_slots; i++) {
+            TileArchiveSlot *s = &slots[(h + i) % header->num_slots];
+            if (s->tile == 0 || (s->x == cell.x && s->y == cell.y)) {
+                return s;
+            }
+        }
+        return nullptr;
+    }
+
+  public:
+    TileArchive() {}
+    ~TileArchive() { close(); }
+
+    // Maps the archive at _path, creating or rebuilding it when missing or
+    // generated with other parameters. Returns false if it can't be mapped.
+    bool open(const std::string &_path, unsigned int tile_w,
+              unsigned int tile_h, unsigned int capacity,
+              const NoiseParams &p) {
+#ifdef _WIN32
+        std::cout << "TileArchive: memory mapping is not supported on this "
+                     "platform, archive disabled"
+                  << std::endl;
+        return false;
+#else
+        close();
+        path = _path;
+        size_t bytes = fileBytes(tile_w, tile_h, capacity, payload_offset);
+
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            std::cout << "TileArchive: could not open " << path << std::endl;
+            return false;
+        }
+
+        // Reuse the existing file only if it was built with these settings
+        TileArchiveHeader existing;
+        memset(&existing, 0, sizeof(existing));
+        struct stat st;
+        memset(&st, 0, sizeof(st));
+        bool is_valid = fstat(fd, &st) == 0 && (size_t)st.st_size == bytes &&
+                        pread(fd, &existing, sizeof(existing), 0) ==
+                            (ssize_t)sizeof(existing) &&
+                        matches(existing, tile_w, tile_h, capacity, p);
+        if (!is_valid) {
+            if (st.st_size > 0) {
+                std::cout << "TileArchive: " << path
+                          << " is stale or corrupt, rebuilding" << std::endl;
+            }
+            if (ftruncate(fd, 0) != 0 || ftruncate(fd, bytes) != 0) {
+                std::cout << "TileArchive: could not size " << path
+                          << std::endl;
+                close();
+                return false;
+            }
+        }
+
+        void *mapping =
+            mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED) {
+            std::cout << "TileArchive: could not map " << path << std::endl;
+            close();
+            return false;
+        }
+        data = (char *)mapping;
+        mapped_bytes = bytes;
+        header = (TileArchiveHeader *)data;
+        slots = (TileArchiveSlot *)(data + HEADER_BYTES);
+
+        if (!is_valid) {
+            // ftruncate zero-filled the file, so the index starts empty
+            memcpy(header->magic, "ITTA", 4);
+            header->version = VERSION;
+            header->tile_w = tile_w;
+            header->tile_h = tile_h;
+            header->capacity = capacity;
+            header->num_slots = capacity * 2;
+            header->tile_count = 0;
+            header->seed = p.seed;
+            header->octaves = p.octaves;
+            header->persistence = p.persistence;
+            header->lateral_scaling = p.lateral_scaling;
+            header->vertical_scaling = p.vertical_scaling;
+            header->vertical_offset = p.vertical_offset;
+            header->min_elevation = p.min_elevation;
+        }
+        std::cout << "TileArchive: " << path << " (" << header->tile_count
+                  << "/" << capacity << " tiles)" << std::endl;
+        return true;
+#endif
+    }
+
+    void close() {
+#ifndef _WIN32
+        if (data != nullptr) {
+            msync(data, mapped_bytes, MS_ASYNC);
+            munmap(data, mapped_bytes);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+#endif
+        fd = -1;
+        data = nullptr;
+        mapped_bytes = 0;
+        header = nullptr;
+        slots = nullptr;
+    }
+
+    bool isOpen() { return data != nullptr; }
+
+    unsigned int size() { return isOpen() ? header->tile_count : 0; }
+
+    // Heights and slopes of cell inside the mapping, or nullptr if not
+    // archived yet
+    const float *find(glm::ivec2 cell) {
+        if (!isOpen()) {
+            return nullptr;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        TileArchiveSlot *s = probe(cell);
+        if (s == nullptr || s->tile == 0) {
+            return nullptr;
+        }
+        return (const float *)(data + payload_offset) +
+               (size_t)(s->tile - 1) * tileFloats();
+    }
+
+    // Appends the heights and slopes of cell (laid out as in the payload)
+    // and returns the archived copy. Returns nullptr once the archive is
+    // full.
+    const float *store(glm::ivec2 cell, const float *tile) {
+        if (!isOpen()) {
+            return nullptr;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        TileArchiveSlot *s = probe(cell);
+        if (s != nullptr && s->tile != 0) {
+            return (const float *)(data + payload_offset) +
+                   (size_t)(s->tile - 1) * tileFloats();
+        }
+        if (s == nullptr || header->tile_count >= header->capacity) {
+            if (!is_full_logged) {
+                std::cout << "TileArchive: " << path << " is full"
+                          << std::endl;
+                is_full_logged = true;
+            }
+            return nullptr;
+        }
+
+        // Payload first, then publish it in the index
+        uint32_t idx = header->tile_count;
+        float *dst = (float *)(data + payload_offset) + idx * tileFloats();
+        memcpy(dst, tile, tileFloats() * sizeof(float));
+        s->x = cell.x;
+        s->y = cell.y;
+        s->tile = idx + 1;
+        header->tile_count = idx + 1;
+        return dst;
+    }
+};
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+/*
+    Interleaved vertex layouts a loaded mesh can be uploaded in, one vertex
+    after the other as position, normal, color:
+
+      FLOAT      float32 xyz, float32 xyz, float32 rgb          36 bytes
+      HALF       float16 xyz + pad, int 10_10_10_2, RGBA8       16 bytes
+      QUANTIZED  unorm16 xyz + pad, int 10_10_10_2, RGBA8       16 bytes
+
+    QUANTIZED positions are relative to the mesh's bounding box: the shader
+    gets them in 0..1 and scales them back with the box size and corner
+    that pack() returns. Normals go in GL_INT_2_10_10_10_REV and colors in
+    normalized unsigned bytes, so the attributes read back as vec3s.
+
+    Nothing here touches GL; Mesh::bindVertexAttributes() maps the layouts
+    to attribute pointers.
+*/
+class VertexFormat {
+  public:
+    enum { FLOAT = 0, HALF = 1, QUANTIZED = 2, NUM_FORMATS = 3 };
+
+    static unsigned int stride(int format) { return format == FLOAT ? 36 : 16; }
+    static unsigned int normalOffset(int format) {
+        return format == FLOAT ? 12 : 8;
+    }
+    static unsigned int colorOffset(int format) {
+        return format == FLOAT ? 24 : 12;
+    }
+
+    static const char *name(int format) {
+        static const char *NAMES[NUM_FORMATS] = {"float", "half", "q16"};
+        return NAMES[format];
+    }
+
+    // Format called name ("float", "half" or "q16"), -1 if there is none
+    static int parse(const std::string &name_) {
+        for (int format = 0; format < NUM_FORMATS; format++) {
+            if (name_ == name(format)) {
+                return format;
+            }
+        }
+        return -1;
+    }
+
+    // Round-to-nearest-even float16, with overflow to infinity and
+    // subnormals
+    static uint16_t toHalf(float value) {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        uint16_t sign = (bits >> 16) & 0x8000;
+        uint32_t magnitude = bits & 0x7fffffff;
+        if (magnitude >= 0x7f800000) { // inf or NaN
+            return sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 : 0);
+        }
+        if (magnitude >= 0x477ff000) { // rounds past the largest half
+            return sign | 0x7c00;
+        }
+        if (magnitude < 0x38800000) { // below the smallest normal half
+            // Scale by 2^24 so the subnormal count ends up in the integer
+            float subnormal;
+            memcpy(&subnormal, &magnitude, sizeof(subnormal));
+            return sign | (uint16_t)std::nearbyint(subnormal * 16777216.0f);
+        }
+        // Re-bias the exponent, then round the 13 dropped mantissa bits
+        uint32_t half = (magnitude - 0x38000000) >> 13;
+        uint32_t rest = magnitude & 0x1fff;
+        if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+            half++;
+        }
+        return sign | (uint16_t)half;
+    }
+
+    // Signed normalized 10_10_10_2, as GL_INT_2_10_10_10_REV reads it
+    static uint32_t packNormal(glm::vec3 n) {
+        uint32_t packed = 0;
+        for (int k = 0; k < 3; k++) {
+            float c = std::max(-1.0f, std::min(1.0f, n[k]));
+            int32_t q = (int32_t)std::lround(c * 511.0f);
+            packed |= ((uint32_t)q & 0x3ff) << (10 * k);
+        }
+        return packed;
+    }
+
+    // RGBA8 with opaque alpha
+    static uint32_t packColor(glm::vec3 c) {
+        uint32_t packed = 0xff000000;
+        for (int k = 0; k < 3; k++) {
+            float v = std::max(0.0f, std::min(1.0f, c[k]));
+            packed |= (uint32_t)std::lround(v * 255.0f) << (8 * k);
+        }
+        return packed;
+    }
+
+    // Interleaves n vertices into out. position_scale and position_offset
+    // get what the shader must apply to read positions back (identity
+    // unless QUANTIZED).
+    static void pack(int format, const glm::vec3 *positions,
+                     const glm::vec3 *normals, const glm::vec3 *colors,
+                     size_t n, std::vector<unsigned char> &out,
+                     glm::vec3 &position_scale, glm::vec3 &position_offset) {
+        position_scale = glm::vec3(1.0f);
+        position_offset = glm::vec3(0.0f);
+        out.assign(n * stride(format), 0);
+        unsigned char *v = out.data();
+        if (format == FLOAT) {
+            for (size_t i = 0; i < n; i++, v += 36) {
+                memcpy(v, &positions[i], 12);
+                memcpy(v + 12, &normals[i], 12);
+                memcpy(v + 24, &colors[i], 12);
+            }
+            return;
+        }
+        if (format == QUANTIZED && n > 0) {
+            glm::vec3 lo = positions[0], hi = positions[0];
+            for (size_t i = 1; i < n; i++) {
+                lo = glm::min(lo, positions[i]);
+                hi = glm::max(hi, positions[i]);
+            }
+            position_offset = lo;
+            for (int k = 0; k < 3; k++) {
+                position_scale[k] = hi[k] > lo[k] ? hi[k] - lo[k] : 1.0f;
+            }
+        }
+        for (size_t i = 0; i < n; i++, v += 16) {
+            uint16_t p[3];
+            for (int k = 0; k < 3; k++) {
+                if (format == HALF) {
+                    p[k] = toHalf(positions[i][k]);
+                } else {
+                    float t = (positions[i][k] - position_offset[k]) /
+                              position_scale[k];
+                    t = std::max(0.0f, std::min(1.0f, t));
+                    p[k] = (uint16_t)std::lround(t * 65535.0f);
+                }
+            }
+            memcpy(v, p, 6);
+            uint32_t normal = packNormal(normals[i]);
+            uint32_t color = packColor(colors[i]);
+            memcpy(v + 8, &normal, 4);
+            memcpy(v + 12, &color, 4);
+        }
+    }
+};
@@ -1,5 +1,8 @@
 #include "Helpers.h"
 
+#include <algorithm>
+#include <cassert>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 
@@ -67,6 +70,15 @@ void VertexBufferObject::updateWithArray(int _rows, int _cols, float *arr, int s
   check_gl_error();
 }
 
+void VertexBufferObject::updateWithData(int _rows, int _cols, const void *data, size_t size) {
+  assert(id != 0);
+  glBindBuffer(GL_ARRAY_BUFFER, id);
+  glBufferData(GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
+  rows = _rows;
+  cols = _cols;
+  check_gl_error();
+}
+
 void VertexBufferObject::updateWithIntVector(const std::vector<int> &vec) {
   assert(id != 0);
   glBindBuffer(GL_ARRAY_BUFFER, id);
@@ -87,6 +99,87 @@ void VertexBufferObject::updateForStaticDraw(const std::vector<float> &vec) {
     check_gl_error();
 }
 
+void IndexBufferObject::init()
+{
+  glGenBuffers(1,&id);
+  check_gl_error();
+}
+
+void IndexBufferObject::update(const unsigned int *indices, size_t n, size_t num_vertices)
+{
+  if (!fitsShort(num_vertices))
+  {
+    updateWithData(indices, n, sizeof(GLuint));
+    return;
+  }
+  std::vector<GLushort> shorts(indices, indices + n);
+  updateWithData(shorts.data(), n, sizeof(GLushort));
+}
+
+void IndexBufferObject::updateWithData(const void *data, size_t n, size_t size)
+{
+  assert(id != 0);
+  assert(size == sizeof(GLushort) || size == sizeof(GLuint));
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, id);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, n * size, data, GL_STATIC_DRAW);
+  type = size == sizeof(GLushort) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+  count = n;
+  check_gl_error();
+}
+
+size_t IndexBufferObject::indexSize() const
+{
+  return type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+}
+
+const void *IndexBufferObject::offset(size_t first) const
+{
+  return (const void *)(first * indexSize());
+}
+
+void IndexBufferObject::bind()
+{
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, id);
+  check_gl_error();
+}
+
+void IndexBufferObject::free()
+{
+  glDeleteBuffers(1,&id);
+  id = 0;
+  check_gl_error();
+}
+
+void UniformBufferObject::init(GLuint _size)
+{
+  size = _size;
+  glGenBuffers(1,&id);
+  glBindBuffer(GL_UNIFORM_BUFFER,id);
+  glBufferData(GL_UNIFORM_BUFFER,size,NULL,GL_DYNAMIC_DRAW);
+  check_gl_error();
+}
+
+void UniformBufferObject::update(const void *data)
+{
+  assert(id != 0);
+  glBindBuffer(GL_UNIFORM_BUFFER,id);
+  glBufferSubData(GL_UNIFORM_BUFFER,0,size,data);
+  check_gl_error();
+}
+
+void UniformBufferObject::bindBase(GLuint binding)
+{
+  glBindBufferBase(GL_UNIFORM_BUFFER,binding,id);
+  check_gl_error();
+}
+
+void UniformBufferObject::free()
+{
+  glDeleteBuffers(1,&id);
+  id = 0;
+  check_gl_error();
+}
+
 bool Program::init(
   const std::string &vertex_shader_string,
   const std::string &fragment_shader_string,
@@ -128,10 +221,36 @@ bool Program::init(
     return false;
   }
 
+  cacheUniformLocations();
   check_gl_error();
   return true;
 }
 
+void Program::cacheUniformLocations()
+{
+  uniform_locations.clear();
+  GLint count = 0;
+  glGetProgramiv(program_shader, GL_ACTIVE_UNIFORMS, &count);
+  for (GLint i = 0; i < count; i++)
+  {
+    char name[256];
+    GLsizei length = 0;
+    GLint size = 0;
+    GLenum type = 0;
+    glGetActiveUniform(program_shader, i, sizeof(name), &length, &size, &type, name);
+    GLint location = glGetUniformLocation(program_shader, name);
+    if (location < 0)
+      continue; // member of a uniform block
+    std::string str(name, length);
+    uniform_locations.push_back(std::make_pair(str, location));
+    // Arrays are reported as "name[0]", also accept plain "name"
+    if (str.size() > 3 && str.compare(str.size() - 3, 3, "[0]") == 0)
+      uniform_locations.push_back(
+          std::make_pair(str.substr(0, str.size() - 3), location));
+  }
+  std::sort(uniform_locations.begin(), uniform_locations.end());
+}
+
 void Program::bind()
 {
   glUseProgram(program_shader);
@@ -143,13 +262,45 @@ GLint Program::attrib(const std::string &name) const
   return glGetAttribLocation(program_shader, name.c_str());
 }
 
+GLint Program::uniform(const char *name) const
+{
+  // Binary search by strcmp, so per-draw lookups of literals don't allocate
+  auto it = std::lower_bound(
+      uniform_locations.begin(), uniform_locations.end(), name,
+      [](const std::pair<std::string, GLint> &entry, const char *key) {
+        return strcmp(entry.first.c_str(), key) < 0;
+      });
+  // Inactive or unknown uniforms are -1, like glGetUniformLocation
+  if (it == uniform_locations.end() || it->first.compare(name) != 0)
+    return -1;
+  return it->second;
+}
+
 GLint Program::uniform(const std::string &name) const
 {
-  return glGetUniformLocation(program_shader, name.c_str());
+  return uniform(name.c_str());
+}
+
+bool Program::bindUniformBlock(const std::string &name, GLuint binding) const
+{
+  GLuint index = glGetUniformBlockIndex(program_shader, name.c_str());
+  if (index == GL_INVALID_INDEX)
+    return false;
+  glUniformBlockBinding(program_shader, index, binding);
+  check_gl_error();
+  return true;
 }
 
 GLint Program::bindVertexAttribArray(
         const std::string &name, VertexBufferObject& VBO) const
+{
+  VertexAttribute attribute = {(GLint)VBO.rows, GL_FLOAT, false, 0, 0};
+  return bindVertexAttribArray(name, VBO, attribute);
+}
+
+GLint Program::bindVertexAttribArray(
+        const std::string &name, VertexBufferObject& VBO,
+        const VertexAttribute &attribute) const
 {
   GLint id = attrib(name);
   if (id < 0)
@@ -164,7 +315,9 @@ GLint Program::bindVertexAttribArray(
   VBO.bind();
   std::cout << "EnablingAttribArray: " << name << "-> " << id << std::endl;
   glEnableVertexAttribArray(id);
-  glVertexAttribPointer(id, VBO.rows, GL_FLOAT, GL_FALSE, 0, 0);
+  glVertexAttribPointer(id, attribute.size, attribute.type,
+                        attribute.normalized ? GL_TRUE : GL_FALSE,
+                        attribute.stride, (const void *)attribute.offset);
   check_gl_error();
 
   return id;
@@ -3,6 +3,7 @@
 
 // #include <Eigen/Core>
 #include <string>
+#include <utility>
 #include <vector>
 
 #ifdef _WIN32
@@ -65,6 +66,8 @@ public:
     void updateWithIntVector(const std::vector<int> &vec);
     void updateForStaticDraw(const std::vector<float> &vec);
     void updateWithArray(int _rows, int _cols, float *arr, int size);
+  // Fills the VBO with size raw bytes for static draw (e.g. from a mapped file)
+  void updateWithData(int _rows, int _cols, const void *data, size_t size);
     // Select this VBO for subsequent draw calls
     void bind();
 
@@ -72,6 +75,81 @@ public:
     void free();
 };
 
+// An element array buffer whose index width follows the vertex count:
+// 16-bit indices when every vertex can be addressed with them, else 32-bit
+class IndexBufferObject
+{
+public:
+    typedef unsigned int GLuint;
+    typedef unsigned int GLenum;
+
+    GLuint id;
+    GLenum type;  // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    GLuint count; // number of indices
+
+    IndexBufferObject() : id(0), type(0), count(0) {}
+
+    // Whether indices into num_vertices vertices fit in 16 bits
+    static bool fitsShort(size_t num_vertices) { return num_vertices <= 65536; }
+
+    // Create a new empty buffer
+    void init();
+
+    // Uploads n indices into num_vertices vertices, narrowed to 16 bits when
+    // they fit
+    void update(const unsigned int *indices, size_t n, size_t num_vertices);
+
+    // Uploads n indices that are already size bytes wide (2 or 4)
+    void updateWithData(const void *data, size_t n, size_t size);
+
+    // Bytes per index
+    size_t indexSize() const;
+
+    // Byte offset of index first, as glDrawElements expects it
+    const void *offset(size_t first) const;
+
+    // Select this buffer as the element array
+    void bind();
+
+    // Release the id
+    void free();
+};
+
+// A std140 uniform block's backing store, shared by every program that
+// binds the block to the same binding point
+class UniformBufferObject
+{
+public:
+    typedef unsigned int GLuint;
+
+    GLuint id;
+    GLuint size;
+
+    UniformBufferObject() : id(0), size(0) {}
+
+    // Create the buffer with room for _size bytes
+    void init(GLuint _size);
+
+    // Replace the whole contents (size bytes)
+    void update(const void *data);
+
+    // Attach to a uniform block binding point
+    void bindBase(GLuint binding);
+
+    // Release the id
+    void free();
+};
+
+// Layout of one vertex attribute inside a VBO
+struct VertexAttribute
+{
+    GLint size;      // components
+    GLenum type;     // GL_FLOAT, GL_HALF_FLOAT, GL_INT_2_10_10_10_REV, ...
+    bool normalized; // integers read back as 0..1 (unsigned) or -1..1
+    GLuint stride;   // bytes from one vertex to the next, 0 if packed
+    size_t offset;   // bytes to the first vertex's value
+};
+
 // This class wraps an OpenGL program composed of two shaders
 class Program
 {
@@ -84,6 +162,10 @@ public:
   GLuint program_shader;
   GLuint geometry_shader;
 
+  // Locations of all active uniforms, resolved once after linking. Sorted
+  // by name so lookups by C string need no temporary std::string.
+  std::vector<std::pair<std::string, GLint> > uniform_locations;
+
   Program() : vertex_shader(0), fragment_shader(0), geometry_shader(0), program_shader(0) { }
 
   // Create a new shader from the specified source strings
@@ -102,13 +184,25 @@ public:
   GLint attrib(const std::string &name) const;
 
   // Return the OpenGL handle of a uniform attribute (-1 if it does not exist)
+  GLint uniform(const char *name) const;
   GLint uniform(const std::string &name) const;
 
-  // Bind a per-vertex array attribute
+  // Point a named uniform block at a binding point (false if it does not exist)
+  bool bindUniformBlock(const std::string &name, GLuint binding) const;
+
+  // Bind a per-vertex array attribute of VBO.rows tightly packed floats
   GLint bindVertexAttribArray(const std::string &name, VertexBufferObject& VBO) const;
 
+  // Bind a per-vertex array attribute laid out as described, e.g. one of
+  // several interleaved in the same VBO
+  GLint bindVertexAttribArray(const std::string &name, VertexBufferObject& VBO,
+                              const VertexAttribute &attribute) const;
+
   GLuint create_shader_helper(GLint type, const std::string &shader_string);
 
+private:
+  void cacheUniformLocations();
+
 };
 
 // From: https://blog.nobel-joergensen.com/2013/01/29/debugging-opengl-using-glgeterror/
@@ -16,7 +16,6 @@
 #include "glm/gtx/string_cast.hpp"
 #include <glm/ext.hpp>
 #include <glm/glm.hpp>
-#include <glm/gtc/noise.hpp>
 #include <glm/gtx/matrix_operation.hpp>
 #include <glm/gtx/rotate_vector.hpp>
 
@@ -24,17 +23,36 @@
 #include <chrono>
 
 // std lib
+#include <algorithm>
 #include <cstdlib>
+#include <atomic>
 #include <ctime>
-#include <future>
 #include <math.h>
 
 // Custom classes
+#include <BenchmarkReport.h>
+#include <CameraPath.h>
+#include <Culling.h>
+#include <DrawStats.h>
+#include <FrameTimings.h>
+#include <GpuTimer.h>
+#include <HeadlessContext.h>
+#include <HeightCache.h>
+#include <InstanceBatch.h>
+#include <JobSystem.h>
 #include <Mesh.h>
+#include <Noise.h>
+#include <Profiler.h>
 #include <SceneObject.h>
 #include <SceneObjectList.h>
 #include <Shader.h>
 #include <State.h>
+#include <StatsOverlay.h>
+#include <Terrain.h>
+#include <TerrainClipmap.h>
+#include <TerrainLod.h>
+#include <TerrainNoise.h>
+#include <VertexFormat.h>
 #include <fstream>
 #include <iostream>
 #include <set>
@@ -80,24 +98,10 @@ std::vector<glm::vec3> colors = {
     // GRAY // unused
 };
 
-glm::mat4 MIRROR_3D_NONE = glm::mat4(1.0);
-glm::mat4 MIRROR_3D_X = glm::diagonal4x4(glm::vec4(-1, 1, 1, 1));
-glm::mat4 MIRROR_3D_Y =
-    glm::diagonal4x4(glm::vec4(1, 1, -1, 1)); // Y is Z in grid world
-glm::mat4 MIRROR_3D_XY = glm::diagonal4x4(glm::vec4(-1, 1, -1, 1));
-
-glm::mat2 MIRROR_2D_NONE = glm::mat2(1.0);
-glm::mat2 MIRROR_2D_X = glm::diagonal2x2(glm::vec2(-1, 1));
-glm::mat2 MIRROR_2D_Y =
-    glm::diagonal2x2(glm::vec2(1, -1)); // Y is Z in grid world
-glm::mat2 MIRROR_2D_XY = glm::diagonal2x2(glm::vec2(-1, -1));
-
 // Index buffer stuff
 
 GLuint elementbuffer;
-GLuint mesh_1_index_buffer;
-GLuint mesh_2_index_buffer;
-GLuint mesh_3_index_buffer;
+IndexBufferObject mesh_index_buffers[3]; // one per mesh id
 
 // Rendering to texture
 GLuint framebufferOut;
@@ -122,11 +126,10 @@ std::vector<float> g_quad_vertex_buffer_data = {
 // Quad program
 Program quad_program;
 
-GLuint mesh_index_buffer_refs[3] = {
-    mesh_1_index_buffer,
-    mesh_2_index_buffer,
-    mesh_3_index_buffer,
-};
+// GPU time of the render passes and the stats overlay (O key)
+GpuTimer gpu_timer;
+StatsOverlay stats_overlay;
+
 
 // Contains the vertex positions
 // Command line flags
@@ -138,18 +141,109 @@ std::string G_SHADER_PATH = "-g";
 std::string MESH_1_PATH = "-m1";
 std::string MESH_2_PATH = "-m2";
 std::string MESH_3_PATH = "-m3";
+std::string HEIGHT_CACHE_MB = "-hc";
+std::string TILE_ARCHIVE_PATH = "-ta";
+std::string NOISE_SEED = "-seed";
+std::string TERRAIN_RADIUS_FLAG = "-tr";
+std::string TERRAIN_LOD_FLAG = "-lod";
+std::string TERRAIN_MODE_FLAG = "-tm";
+std::string CLIPMAP_LEVELS_FLAG = "-cl";
+std::string VERTEX_FORMAT_FLAG = "-vf";
+std::string MESH_OPTIMIZE_FLAG = "-mo";
+std::string HEADLESS_FLAG = "--headless";
+std::string FRAMES_FLAG = "--frames";
+std::string RECORD_FLAG = "--record";
+std::string REPLAY_FLAG = "--replay";
+std::string REPORT_FLAG = "--report";
+std::string TRACE_FLAG = "--trace";
 
 // Values for mesh paths
 std::string mesh_1_path = "";
 std::string mesh_2_path = "";
 std::string mesh_3_path = "";
 
+// Memory budget of the terrain height cache
+float height_cache_mb = 16.0f;
+
+// On-disk tile archive, disabled when no path is given
+std::string tile_archive_path = "";
+unsigned int noise_seed = 0;
+const unsigned int TILE_ARCHIVE_CAPACITY = 4096; // tiles
+
 // Is debug mode enabled
 bool DEBUG_MODE_ENABLED = false;
 bool ASYNC_ENABLED = true;
 std::mutex key_mutex;            // mutex for key handling
 std::mutex terrain_update_mutex; // mutex for terrain updating handling
 
+// Persistent worker pool for terrain updates and mesh generation
+JobSystem *jobs = nullptr;
+TerrainStreamer *terrain = nullptr;    // streams unique tiles around player
+HeightTileCache *height_cache = nullptr; // heights of recently visited tiles
+TerrainLod *terrain_lod = nullptr;       // index sets per LOD level
+// One instanced draw per (LOD level, stitch mask) in use
+std::map<int, InstanceBatch> terrain_batches;
+// Screen-space error allowed before a tile goes finer, 0 disables LOD
+float terrain_lod_tolerance_px = 2.0f;
+SphereCuller scene_culler;               // scene object bounds, per frame
+std::vector<unsigned char> is_visible;   // per scene object, from culling
+CullStats cull_stats;                    // this frame's culling counts
+const int TERRAIN_TEXTURE_UNIT = 1;      // unit 0 is the quad pass texture
+// Terrain backend, "tiles" (streamed tiles) or "clipmap"
+std::string terrain_mode = "tiles";
+TerrainClipmap *clipmap = nullptr; // in place of the tiles in clipmap mode
+int clipmap_levels = 4;
+const int CLIPMAP_SIZE = 63;         // vertices per level row, 4k + 3
+const int CLIPMAP_MESH_ID = 3;       // shader path only, not in meshes
+const int CLIPMAP_TEXTURE_UNIT = 3;  // after the tile pool's two units
+// Vertex layout of meshes loaded from files, see VertexFormat
+int vertex_format = VertexFormat::QUANTIZED;
+// Reorder the triangles of meshes parsed at load time, see MeshOptimizer
+bool should_optimize_meshes = true;
+
+// --headless renders a fixed number of frames into an FBO, with no window
+bool is_headless = false;
+int headless_frames = -1; // -1: the whole replay, else 300
+HeadlessContext headless;
+// Framebuffer standing in for the window: 0, or the headless FBO
+GLuint screen_framebuffer = 0;
+
+// Flythrough recording and replay, see CameraPath
+std::string record_path = "";
+std::string replay_path = "";
+std::string report_path = ""; // benchmark JSON, see BenchmarkReport
+// Chrome trace of the CPU zones, see Profiler. --trace captures from the
+// start; without it the trace key starts a capture and writes it here.
+std::string trace_path = "";
+const std::string DEFAULT_TRACE_PATH = "trace.json";
+CameraPath camera_path;   // being replayed
+CameraPath recorded_path; // being recorded
+
+// CPU mirror of the std140 FrameUniforms block shared by the shaders of the
+// main program. vec3s are followed by a float so they pack into 16 bytes.
+struct FrameUniforms {
+    glm::mat4 view_matrix;
+    glm::mat4 projection_matrix;
+    glm::vec3 light_position;
+    float time;
+    glm::vec3 blinking_color;
+    float delta;
+    glm::vec3 background_color;
+    float min_elevation;
+    float max_elevation;
+    int grid_width;
+    int debug_visuals;
+    int grid_height;
+};
+static_assert(sizeof(FrameUniforms) == 192, "must match the std140 layout");
+const GLuint FRAME_UNIFORMS_BINDING = 0;
+UniformBufferObject frame_ubo;
+TileArchive tile_archive;                // heights, slopes of visited tiles
+double TERRAIN_UPLOAD_BUDGET_MS = 2.0; // GL upload time allowed per frame
+std::atomic<bool> terrain_update_queued(false);
+std::mutex terrain_cell_mutex;  // guards terrain_update_cell
+glm::ivec2 terrain_update_cell; // player cell the next update targets
+
 // Macro for visual debugging
 // #define DEBUG_VISUALS 1
 
@@ -166,7 +260,8 @@ float INITIAL_ZOOM_AMOUNT = 3.0f;
 float SKY_LIGHTING = 1.0;
 
 // Object containers
-const int MAX_TERRAIN_TILES = 9;
+int terrain_radius = 1; // tiles kept on each side of the player
+const int TERRAIN_MESH_ID = 2;
 SceneObjectList scene_objects;
 std::vector<int> terrain_objects;
 SceneObject *player;
@@ -185,7 +280,6 @@ float z_sensitivity = 1.0;
 int y_inversion = 1;
 int x_inversion = 1;
 int z_inversion = 1;
-const float INF = 100000.0;
 double last_mouse_x = 0.0f;
 double last_mouse_y = 0.0f;
 
@@ -222,12 +316,9 @@ const unsigned int YMAX = 50;
 const float ELEVATION_SCALE = 10.0;
 #endif
 
-const int MEMO_X_SIZE = XMAX * 20;
-const int MEMO_Y_SIZE = YMAX * 20;
 float MIN_ELEVATION = 0.0;
 float MAX_ELEVATION = ELEVATION_SCALE;
 float MOVE_SPEED = 0.75;
-float E[MEMO_X_SIZE][MEMO_Y_SIZE]; // grid of elevation values for mesh
 
 glm::vec2 player_position(0, 0);
 
@@ -238,114 +329,106 @@ void rotateCamera(float rot_angle);
 void translateSelectedModelInstance(glm::vec3 updated_translation);
 
 // Function definitions
-float perlinOctave(float x, float y) {
-    double total = 0;
-    double frequency = 1;
-    int octaves = PERLIN_OCTAVES;
-    double persistence = PERLIN_PERSISTENCE;
-    double amplitude = 1;
-    double maxValue = 0; // Used for normalizing result to 0.0 - 1.0
-    for (int i = 0; i < octaves; i++) {
-        glm::vec2 v(x * frequency, y * frequency);
-        total += glm::perlin(v) * amplitude;
-
-        maxValue += amplitude;
-
-        amplitude *= persistence;
-        frequency *= 2;
-    }
-
-    return (float)(total / maxValue);
+NoiseParams makeNoiseParams() {
+    NoiseParams p;
+    p.octaves = PERLIN_OCTAVES;
+    p.persistence = PERLIN_PERSISTENCE;
+    p.lateral_scaling = 0.1;
+    p.vertical_scaling = ELEVATION_SCALE;
+    p.vertical_offset = 0.5;
+    p.min_elevation = MIN_ELEVATION;
+    p.seed = noise_seed;
+    return p;
 }
 
+NoiseParams NOISE_PARAMS = makeNoiseParams();
+
+// Re-targets terrain tiles around the latest requested grid cell
 void updateTerrain() {
-    if (!terrain_update_mutex.try_lock()) {
-        return;
+    ProfileZone zone("updateTerrain");
+    std::lock_guard<std::mutex> lock(terrain_update_mutex);
+    glm::ivec2 cell;
+    {
+        std::lock_guard<std::mutex> cell_lock(terrain_cell_mutex);
+        cell = terrain_update_cell;
     }
-    for (int i = 0; i < terrain_objects.size(); i++) {
-        SceneObject *so = scene_objects.at(terrain_objects[i]);
-        glm::vec2 so_loc = so->getWorldGridPos(XMAX - 1, YMAX - 1);
-        glm::vec2 p_loc = player->getWorldGridPos(XMAX - 1, YMAX - 1);
-        glm::vec2 dir = p_loc - so_loc;
-        float x_dist = dir.x;
-        float y_dist = dir.y;
-        glm::vec3 t(0.0f, 0.0f, 0.0f);
-
-        if (abs(x_dist) >= 2.0) {
-            float x = (glm::sign(x_dist) * 3.0f) * (XMAX - 1);
-            t.x = x;
-        }
-
-        if (abs(y_dist) >= 2.0) {
-            float y = (glm::sign(y_dist) * 3.0f) * (YMAX - 1);
-            t.z = y;
-        }
-        if (abs(x_dist) > 0.001 || abs(y_dist) > 0.001) {
-            so->translate(t);
-        }
-
-        glm::vec2 so_next_loc = so->getWorldGridPos(XMAX - 1, YMAX - 1);
-
-        /*
-
-            Mirroring is applied to whichever the odd-numbered
-            grid coordinate is.
-
-        */
-
-        // Case 0: No mirroring
-        glm::mat4 mirroring_mat = MIRROR_3D_NONE; // No mirroring by default
-
-        // Set mirroring
-        int so_x = (int)so_next_loc.x;
-        int so_y = (int)so_next_loc.y;
-        // Case 1: both are odd
-        if (so_x % 2 != 0 && so_y % 2 != 0) {
-            mirroring_mat = MIRROR_3D_XY;
-            // Case 2: y is odd, x is even
-        } else if (so_y % 2 != 0 && so_x % 2 == 0) {
-            mirroring_mat = MIRROR_3D_Y;
-            // Case 3: x is odd, y is even
-        } else if (so_x % 2 != 0 && so_y % 2 == 0) {
-            mirroring_mat = MIRROR_3D_X;
-        }
+    terrain->update(cell);
+}
 
-        so->setMirroring(mirroring_mat);
+// Queues at most one pending terrain update on the job system. Moves that
+// arrive while an update is queued are picked up by that same update.
+// Called on the main thread, which owns the player: the player's cell is
+// read here so the job never touches it.
+void requestTerrainUpdate() {
+    // The clipmap follows the player every frame instead
+    if (terrain == nullptr) {
+        return;
+    }
+    glm::vec2 p_loc = player->getWorldGridPos(XMAX - 1, YMAX - 1);
+    {
+        std::lock_guard<std::mutex> cell_lock(terrain_cell_mutex);
+        terrain_update_cell = glm::ivec2((int)p_loc.x, (int)p_loc.y);
+    }
+    if (!ASYNC_ENABLED || jobs == nullptr) {
+        updateTerrain();
+        return;
+    }
+    if (!terrain_update_queued.exchange(true)) {
+        jobs->submit([] {
+            terrain_update_queued = false;
+            updateTerrain();
+        });
     }
-    terrain_update_mutex.unlock();
 }
 
 // END
 
-float noise(float x, float y) {
-    int xi = (int)(x * MEMO_X_SIZE);
-    int yi = (int)(y * MEMO_Y_SIZE);
+// Fills the heights and slopes of one world cell, see TerrainNoise.h
+void generateHeightTile(glm::ivec2 cell, unsigned int w, unsigned int h,
+                        float *heights, float *slopes) {
+    terrainHeightCell(NOISE_PARAMS, jobs, cell, w, h, heights);
+    glm::ivec2 origin(cell.x * (int)(w - 1), cell.y * (int)(h - 1));
+    terrainSlopeTile(NOISE_PARAMS, jobs, origin, w, h, slopes);
+}
 
-    // TODO: MEMOIZE
-    if (E[xi][yi] > -INF) {
-        return E[xi][yi];
-    } else {
-        float vertical_scaling = ELEVATION_SCALE;
-        float vertical_offset = 0.5;
-        float lateral_scaling = 0.1;
-        float val = perlinOctave(x * lateral_scaling, y * lateral_scaling) *
-                        vertical_scaling +
-                    vertical_offset;
-        if (val < MIN_ELEVATION) {
-            val = MIN_ELEVATION;
-        }
-        E[xi][yi] = val; // is this necessary?
-        return val;
+// Heights and slopes of clipmap samples. Like the tiles, world vertex x
+// samples the noise at x / XMAX. Runs for every row of every updated strip,
+// so its scratch rows persist per thread and only grow.
+void noiseClipmapRow(const float *xs, float z, unsigned int n, float *heights,
+                     float *slopes) {
+    static thread_local std::vector<float> noise_xs;
+    static thread_local std::vector<float> dx;
+    static thread_local std::vector<float> dz;
+    if (noise_xs.size() < n) {
+        noise_xs.resize(n);
+        dx.resize(n);
+        dz.resize(n);
+    }
+    for (unsigned int i = 0; i < n; i++) {
+        noise_xs[i] = xs[i] / XMAX;
+    }
+    terrainHeightRowD(&noise_xs[0], z / YMAX, n, NOISE_PARAMS, heights, &dx[0],
+                      &dz[0]);
+    for (unsigned int i = 0; i < n; i++) {
+        slopes[i * 2] = dx[i] / XMAX;
+        slopes[i * 2 + 1] = dz[i] / YMAX;
     }
 }
 
-void initNoiseTexture() {
-    // Create memo table
-    for (int x = 0; x < MEMO_X_SIZE; x++) {
-        for (int y = 0; y < MEMO_Y_SIZE; y++) {
-            E[x][y] = -INF;
-        }
-    }
+// Terrain tile heights, served from the height cache
+void noiseTile(glm::ivec2 grid_origin, unsigned int w, unsigned int h,
+               float *out) {
+    glm::ivec2 cell(grid_origin.x / (int)(w - 1), grid_origin.y / (int)(h - 1));
+    HeightTileCache::Tile tile = height_cache->get(cell);
+    std::copy(tile.get(), tile.get() + w * h, out);
+}
+
+// Terrain tile slopes, stored in the height cache after the heights
+void noiseSlopeTile(glm::ivec2 grid_origin, unsigned int w, unsigned int h,
+                    float *slopes) {
+    glm::ivec2 cell(grid_origin.x / (int)(w - 1), grid_origin.y / (int)(h - 1));
+    HeightTileCache::Tile tile = height_cache->get(cell);
+    std::copy(tile.get() + w * h, tile.get() + w * h * 3, slopes);
 }
 
 void shiftTerrainBlockInWorldGrid(SceneObject *so_ptr, float x, float y) {
@@ -354,37 +437,36 @@ void shiftTerrainBlockInWorldGrid(SceneObject *so_ptr, float x, float y) {
 }
 
 void initWorld() {
-    glm::vec2 grid[9] = {
-        glm::vec2(-1, 1),  glm::vec2(0, 1),  glm::vec2(1, 1),  //
-        glm::vec2(-1, 0),  glm::vec2(0, 0),  glm::vec2(1, 0),  //
-        glm::vec2(-1, -1), glm::vec2(0, -1), glm::vec2(1, -1), //
-    };
-
-    glm::mat4 grid_mirror[9] = {
-        //
-        MIRROR_3D_XY, MIRROR_3D_Y,    MIRROR_3D_XY, //
-        MIRROR_3D_X,  MIRROR_3D_NONE, MIRROR_3D_X,  //
-        MIRROR_3D_XY, MIRROR_3D_Y,    MIRROR_3D_XY, //
-    };
-
-    terrain_objects.reserve(9);
-    for (int i = 0; i < 9; i++) {
-        createModelInstance(2); // Add terrain
-        SceneObject *so_ptr = scene_objects.at(i);
-        so_ptr->setColor(i);
-        so_ptr->setMirroring(grid_mirror[i]);
-        glm::vec3 t(grid[i].x * (XMAX - 1), 0.0, grid[i].y * (YMAX - 1));
-        so_ptr->translate(t);
-        glm::vec2 w = so_ptr->getWorldGridPos(XMAX - 1, YMAX - 1);
-        terrain_objects.emplace_back(i);
-    }
+    terrain_lod = new TerrainLod(XMAX, YMAX);
 
-    // scene_objects
+    if (terrain_mode == "clipmap") {
+        // No terrain scene objects, the clipmap is drawn on its own
+        clipmap = new TerrainClipmap(CLIPMAP_SIZE, clipmap_levels,
+                                     noiseClipmapRow);
+        clipmap->init();
+    } else {
+        // One scene object per streamed tile, placed once its mesh is
+        // uploaded
+        terrain =
+            new TerrainStreamer(XMAX, YMAX, terrain_radius, TERRAIN_MESH_ID,
+                                noiseTile, noiseSlopeTile, jobs);
+        terrain_objects.reserve(terrain->numTiles());
+        for (int i = 0; i < terrain->numTiles(); i++) {
+            createModelInstance(2); // Add terrain
+            SceneObject *so_ptr = scene_objects.at(i);
+            so_ptr->setColor(i);
+            terrain->addTile(i);
+            terrain_objects.emplace_back(i);
+        }
 
-    // Update positions an mirrorings
+        // Generate the starting neighbourhood before the first frame
+        terrain->update(glm::ivec2(0, 0));
+        terrain->finish();
+        terrain->uploadReady(scene_objects, -1.0);
+    }
 
     createModelInstance(0);       // Add robot
-    player = scene_objects.at(9); // Store ref to robot
+    player = scene_objects.at(terrain_objects.size()); // Store ref to robot
     player->setColor(8);
     player->rotation_axis_idx = 1;
     player->rotate(0.75f);
@@ -397,13 +479,19 @@ void initWorld() {
 void loadMeshes() {
     // Load meshes
 
-    Mesh robot(mesh_2_path, 0);
-    Mesh bumpy_cube(mesh_3_path, 1);
-
-    initNoiseTexture();
+    Mesh robot(mesh_2_path, 0, jobs, vertex_format, should_optimize_meshes);
+    Mesh bumpy_cube(mesh_3_path, 1, jobs, vertex_format,
+                    should_optimize_meshes);
 
     // Mesh cube(mesh_1_path, 2);
-    Mesh terrain(2, XMAX, YMAX, noise);
+    // Terrain tiles draw from their HeightfieldPool with the shared LOD
+    // index sets (see initIndexBuffer), so the terrain slot keeps no
+    // geometry: only the bounds of the start tile, whose heights come from
+    // the height cache and tile archive like every other tile's
+    HeightfieldMesh start_tile(TERRAIN_MESH_ID, XMAX, YMAX, noiseTile,
+                               noiseSlopeTile, glm::ivec2(0, 0), nullptr, 0);
+    start_tile.build();
+    Mesh terrain = start_tile; // the Mesh part only, heights stay behind
 
     // Add meshes to array
     meshes.push_back(robot);
@@ -413,12 +501,7 @@ void loadMeshes() {
 
 void bufferMeshes() {
     for (int i = 0; i < meshes.size(); i++) {
-        Mesh *mesh = &meshes[i];
-        mesh->vertex_key_name = "mesh_" + std::to_string(i) + "_position";
-        mesh->vertex_color_key_name =
-            "mesh_" + std::to_string(i) + "_vertexColor";
-        mesh->vertex_normal_key_name =
-            "mesh_" + std::to_string(i) + "_vertexNormal";
+        meshes[i].setAttributeKeyNames(i);
     }
 }
 
@@ -445,6 +528,7 @@ void setModelMatrix(SceneObjectList &scene_objects, int model_idx) {
 }
 
 void setViewMatrix() {
+    ProfileZone zone("setViewMatrix");
     float x = UI_STATE.camera_position.x;
     float y = UI_STATE.camera_position.y;
     float z = UI_STATE.camera_position.z;
@@ -476,6 +560,7 @@ void setViewMatrix() {
 }
 
 void setProjectionMatrix() {
+    ProfileZone zone("setProjectionMatrix");
     float aspect_ratio =
         UI_STATE
             .aspect_ratio; // Aspect Ratio. Depends on the size of your window.
@@ -607,50 +692,15 @@ void createModelInstance(int meshId) {
     last_used_color_idx = next_color_idx; // updates last used color
 }
 
-float getYfromXZ(float x, float z) {
-    glm::vec2 in_vec(x, z);
-    glm::vec2 p_loc = player->getWorldGridPos(XMAX, YMAX);
-
-    /*
-
-        Mirroring is applied to whichever the odd-numbered
-        grid coordinate is.
-
-    */
-
-    // Set mirroring
-    int so_x = (int)p_loc.x;
-    int so_y = (int)p_loc.y;
-    glm::vec2 out_vec = in_vec;
-    // Case 1: both are odd
-    if (so_x % 2 != 0 && so_y % 2 != 0) {
-        out_vec.x = 1.0f - out_vec.x;
-        out_vec.y = 1.0f - out_vec.y;
-        // Case 2: y is odd, x is even
-    } else if (so_y % 2 != 0 && so_x % 2 == 0) {
-        // out_vec.x = 1.0f - out_vec.x;
-        out_vec.y = 1.0f - out_vec.y;
-        // Case 3: x is odd, y is even
-    } else if (so_x % 2 != 0 && so_y % 2 == 0) {
-        // mirroring_mat = MIRROR_2D_X;
-        out_vec.x = 1.0f - out_vec.x;
-    }
-
-    return noise(out_vec.x, out_vec.y);
-}
-
 void translateSelectedModelInstance(glm::vec3 updated_translation) {
-    float elevation_scale = ELEVATION_SCALE;
-    float lateral_scaling = 0.1;
     if (UI_STATE.selected_model_idx != -1) {
         SceneObject *so = scene_objects.at(UI_STATE.selected_model_idx);
         float last_elevation = so->elevation_offset;
-        float x = ((int)(so->translation.x + updated_translation.x) % XMAX) /
-                  (float)XMAX;
-        float z = ((int)(so->translation.z + updated_translation.z) % YMAX) /
-                  (float)YMAX;
+        // Terrain vertices sit on integer world coords
+        int x = (int)floor(so->translation.x + updated_translation.x);
+        int z = (int)floor(so->translation.z + updated_translation.z);
         float height = so->mesh->mesh_radius * so->scale.y;
-        float next_elevation = getYfromXZ(x, z) + height;
+        float next_elevation = height_cache->heightAt(x, z) + height;
         so->elevation_offset = next_elevation;
         float delta_el = next_elevation - last_elevation;
 
@@ -661,7 +711,7 @@ void translateSelectedModelInstance(glm::vec3 updated_translation) {
         translateLight(updated_translation);
 
         // Asynchronously apply terrain updates accordingly
-        std::async(std::launch::async, updateTerrain);
+        requestTerrainUpdate();
     }
 }
 
@@ -748,10 +798,11 @@ void moveCamera(int key) {
     }
 }
 
+// Runs on the main thread, like everything else that reads the player,
+// camera and UI state
 void handle_key(int key, int mods, float scale) {
-    if (!key_mutex.try_lock()) {
-        return; // mutex unavailable, skip key handling
-    }
+    ProfileZone zone("handleKey");
+    std::lock_guard<std::mutex> lock(key_mutex);
     // Update the position of the first vertex if the keys 1,2, or 3 are pressed
     switch (key) {
     case GLFW_KEY_1:
@@ -797,7 +848,50 @@ void handle_key(int key, int mods, float scale) {
     default:
         break;
     }
-    key_mutex.unlock(); // release mutex
+}
+
+// Fills the overlay with last frame's CPU time and GPU pass times (read
+// back a few frames late) and this frame's draws, culling and resident
+// tiles
+void updateStatsOverlay(float cpu_ms, const DrawStats &draws,
+                        int tiles_resident) {
+    char line[64];
+    stats_overlay.clear();
+    snprintf(line, sizeof(line), "CPU FRAME %6.2f MS %5.0f FPS", cpu_ms,
+             cpu_ms > 0.0f ? 1000.0f / cpu_ms : 0.0f);
+    stats_overlay.addLine(line);
+    float main_ms =
+        gpu_timer.ms(GpuTimer::TERRAIN) + gpu_timer.ms(GpuTimer::OBJECTS);
+    snprintf(line, sizeof(line), "GPU MAIN  %6.2f MS", main_ms);
+    stats_overlay.addLine(line);
+    for (int p = 0; p < GpuTimer::NUM_PASSES; p++) {
+        snprintf(line, sizeof(line), "  %-7s %6.2f MS", GpuTimer::name(p),
+                 gpu_timer.ms(p));
+        stats_overlay.addLine(line);
+    }
+    snprintf(line, sizeof(line), "DRAWS %u TRIS %lu", draws.draw_calls,
+             draws.triangles);
+    stats_overlay.addLine(line);
+    snprintf(line, sizeof(line), "OBJECTS %u DRAWN %u CULLED",
+             cull_stats.drawn, cull_stats.culled);
+    stats_overlay.addLine(line);
+    snprintf(line, sizeof(line), "TILES %d", tiles_resident);
+    stats_overlay.addLine(line);
+}
+
+// Starts capturing profiling zones, or writes the capture running
+void toggleTrace() {
+    Profiler &profiler = Profiler::get();
+    if (!Profiler::isCapturing()) {
+        if (!profiler.start()) {
+            return;
+        }
+        std::cout << "Profiler: capturing, press T again to write the trace"
+                  << std::endl;
+        return;
+    }
+    profiler.stop();
+    profiler.write(trace_path != "" ? trace_path : DEFAULT_TRACE_PATH);
 }
 
 // Keyboard Callback
@@ -813,6 +907,15 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action,
         }
         return;
     }
+    if (key == GLFW_KEY_O) {
+        UI_STATE.should_show_stats = !UI_STATE.should_show_stats;
+        return;
+    }
+    // Starts a trace capture, or writes the one running
+    if (key == GLFW_KEY_T) {
+        toggleTrace();
+        return;
+    }
     KEYS.insert(key);
 }
 
@@ -890,6 +993,43 @@ void mouse_button_callback(GLFWwindow *window, int button, int action,
     }
 }
 
+// The player and camera state the current frame is drawn with
+CameraPathFrame capturePathFrame() {
+    std::lock_guard<std::mutex> lock(key_mutex);
+    CameraPathFrame f;
+    f.player_position = player->translation;
+    f.player_rotation = player->rotation_angle;
+    f.player_elevation = player->elevation_offset;
+    f.camera_position = UI_STATE.camera_position;
+    f.light_position = UI_STATE.light_position;
+    f.zoom = UI_STATE.current_zoom;
+    f.sky_lighting = SKY_LIGHTING;
+    f.is_pixelated = UI_STATE.should_use_secondary_renderer;
+    f.pixel_width = UI_STATE.pixel_width;
+    return f;
+}
+
+// Puts the player and camera where a recorded frame had them, streaming in
+// terrain as moves would
+void applyPathFrame(const CameraPathFrame &f) {
+    ProfileZone zone("applyPathFrame");
+    std::lock_guard<std::mutex> lock(key_mutex);
+    glm::vec2 last_cell = player->getWorldGridPos(XMAX - 1, YMAX - 1);
+    player->translation = f.player_position;
+    player->rotation_angle = f.player_rotation;
+    player->elevation_offset = f.player_elevation;
+    player->updateModel();
+    UI_STATE.camera_position = f.camera_position;
+    UI_STATE.light_position = f.light_position;
+    UI_STATE.current_zoom = f.zoom;
+    SKY_LIGHTING = f.sky_lighting;
+    UI_STATE.should_use_secondary_renderer = f.is_pixelated != 0;
+    UI_STATE.pixel_width = f.pixel_width;
+    if (player->getWorldGridPos(XMAX - 1, YMAX - 1) != last_cell) {
+        requestTerrainUpdate();
+    }
+}
+
 void setAspectRatioViewMatrix(int width, int height) {
     WIDTH = width;
     HEIGHT = height;
@@ -904,19 +1044,30 @@ void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
     setAspectRatioViewMatrix(w, h);
 }
 
-// Generates an index buffer and binds it to element buffer
+// Generates an index buffer and binds it to element buffer. Indices are
+// 16-bit whenever the mesh has few enough vertices.
 void initIndexBuffer() {
     for (int i = 0; i < meshes.size(); i++) {
-        Mesh *m = &meshes[i];
-        std::cout << "Init buffer: " << i << " size: " << m->indices.size()
+        // Cached meshes uploaded their indices straight from the cache file
+        if (meshes[i].IBO.id != 0) {
+            mesh_index_buffers[i] = meshes[i].IBO;
+            continue;
+        }
+        mesh_index_buffers[i].init();
+        if (i == TERRAIN_MESH_ID) {
+            // Every terrain tile draws with the shared LOD index sets
+            const vector<unsigned int> &indices = terrain_lod->allIndices();
+            mesh_index_buffers[i].update(&indices[0], indices.size(),
+                                         XMAX * YMAX);
+        } else {
+            mesh_index_buffers[i].update(meshes[i].faceIndices(),
+                                         meshes[i].faces.size() * 3,
+                                         meshes[i].vertices.size());
+        }
+        std::cout << "Init buffer: " << i
+                  << " size: " << mesh_index_buffers[i].count << " ("
+                  << mesh_index_buffers[i].indexSize() * 8 << "-bit)"
                   << std::endl;
-        glGenBuffers(1, &mesh_index_buffer_refs[i]);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh_index_buffer_refs[i]);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER,                  //
-                     m->indices.size() * sizeof(unsigned int), //
-                     &m->indices[0],
-                     GL_STATIC_DRAW //
-        );
     }
 }
 
@@ -992,6 +1143,55 @@ void configure_from_args(int argc, char *argv[], std::string &v_shader_path,
             mesh_3_path = argv[arg_idx + 1];
         } else if (argv[arg_idx] == G_SHADER_PATH && (arg_idx + 1) < argc) {
             g_shader_path = argv[arg_idx + 1];
+        } else if (argv[arg_idx] == HEIGHT_CACHE_MB && (arg_idx + 1) < argc) {
+            height_cache_mb = std::stof(argv[arg_idx + 1]);
+        } else if (argv[arg_idx] == TILE_ARCHIVE_PATH && (arg_idx + 1) < argc) {
+            tile_archive_path = argv[arg_idx + 1];
+        } else if (argv[arg_idx] == NOISE_SEED && (arg_idx + 1) < argc) {
+            noise_seed = std::stoul(argv[arg_idx + 1]);
+        } else if (argv[arg_idx] == TERRAIN_RADIUS_FLAG &&
+                   (arg_idx + 1) < argc) {
+            terrain_radius = std::max(0, std::stoi(argv[arg_idx + 1]));
+        } else if (argv[arg_idx] == TERRAIN_LOD_FLAG && (arg_idx + 1) < argc) {
+            terrain_lod_tolerance_px = std::stof(argv[arg_idx + 1]);
+        } else if (argv[arg_idx] == TERRAIN_MODE_FLAG && (arg_idx + 1) < argc) {
+            terrain_mode = argv[arg_idx + 1];
+        } else if (argv[arg_idx] == CLIPMAP_LEVELS_FLAG &&
+                   (arg_idx + 1) < argc) {
+            clipmap_levels = std::max(1, std::stoi(argv[arg_idx + 1]));
+        } else if (argv[arg_idx] == VERTEX_FORMAT_FLAG &&
+                   (arg_idx + 1) < argc) {
+            vertex_format = VertexFormat::parse(argv[arg_idx + 1]);
+            if (vertex_format < 0) {
+                std::cout << "Unknown vertex format " << argv[arg_idx + 1]
+                          << ", using float" << std::endl;
+                vertex_format = VertexFormat::FLOAT;
+            }
+        } else if (argv[arg_idx] == MESH_OPTIMIZE_FLAG &&
+                   (arg_idx + 1) < argc) {
+            should_optimize_meshes = std::stoi(argv[arg_idx + 1]) != 0;
+        } else if (argv[arg_idx] == HEADLESS_FLAG && (arg_idx + 1) < argc) {
+            int w, h;
+            if (sscanf(argv[arg_idx + 1], "%dx%d", &w, &h) == 2 && w > 0 &&
+                h > 0) {
+                is_headless = true;
+                WIDTH = w;
+                HEIGHT = h;
+            } else {
+                std::cout << "Headless size must be WxH, e.g. 1280x720"
+                          << std::endl;
+                exit(1);
+            }
+        } else if (argv[arg_idx] == FRAMES_FLAG && (arg_idx + 1) < argc) {
+            headless_frames = std::max(1, std::stoi(argv[arg_idx + 1]));
+        } else if (argv[arg_idx] == RECORD_FLAG && (arg_idx + 1) < argc) {
+            record_path = argv[arg_idx + 1];
+        } else if (argv[arg_idx] == REPLAY_FLAG && (arg_idx + 1) < argc) {
+            replay_path = argv[arg_idx + 1];
+        } else if (argv[arg_idx] == REPORT_FLAG && (arg_idx + 1) < argc) {
+            report_path = argv[arg_idx + 1];
+        } else if (argv[arg_idx] == TRACE_FLAG && (arg_idx + 1) < argc) {
+            trace_path = argv[arg_idx + 1];
         }
         arg_idx++;
     }
@@ -1007,34 +1207,55 @@ int main(int argc, char *argv[]) {
     configure_from_args(argc, argv, v_shader_path, f_shader_path, g_shader_path,
                         v2_shader_path, f2_shader_path);
 
-    GLFWwindow *window;
+    Profiler::setThreadName("main");
+    if (trace_path != "") {
+        Profiler::get().start();
+    }
 
-    // Initialize the library
-    if (!glfwInit())
+    bool is_replaying = replay_path != "";
+    if (is_replaying && !camera_path.load(replay_path)) {
         return -1;
+    }
+    if (headless_frames < 0) {
+        headless_frames = is_replaying ? camera_path.frames.size() : 300;
+    }
+
+    GLFWwindow *window = nullptr;
 
-    // Activate supersampling
-    glfwWindowHint(GLFW_SAMPLES, 8);
+    // Without a display there is no window; frames go to an offscreen FBO
+    if (is_headless) {
+        if (!headless.init(WIDTH, HEIGHT)) {
+            return -1;
+        }
+    } else {
+        // Initialize the library
+        if (!glfwInit())
+            return -1;
+
+        // Activate supersampling
+        glfwWindowHint(GLFW_SAMPLES, 8);
 
-    // Ensure that we get at least a 3.2 context
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
+        // Ensure that we get at least a 3.2 context
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
 
-    // On apple we have to load a core profile with forward compatibility
+        // On apple we have to load a core profile with forward compatibility
 #ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
-    // Create a windowed mode window and its OpenGL context
-    window = glfwCreateWindow(WIDTH, HEIGHT, "Infinity Terrain", NULL, NULL);
-    if (!window) {
-        glfwTerminate();
-        return -1;
-    }
+        // Create a windowed mode window and its OpenGL context
+        window =
+            glfwCreateWindow(WIDTH, HEIGHT, "Infinity Terrain", NULL, NULL);
+        if (!window) {
+            glfwTerminate();
+            return -1;
+        }
 
-    // Make the window's context current
-    glfwMakeContextCurrent(window);
+        // Make the window's context current
+        glfwMakeContextCurrent(window);
+    }
 
 #ifndef __APPLE__
     glewExperimental = true;
@@ -1048,24 +1269,55 @@ int main(int argc, char *argv[]) {
     fprintf(stdout, "Status: Using GLEW %s\n", glewGetString(GLEW_VERSION));
 #endif
 
-    // Get real dimensions
-    glfwGetFramebufferSize(window, &WIDTH, &HEIGHT);
+    int major, minor, rev = 0;
+    if (is_headless) {
+        if (!headless.initFramebuffer()) {
+            std::cout << "Headless: framebuffer incomplete" << std::endl;
+            return -1;
+        }
+        screen_framebuffer = headless.framebuffer();
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+    } else {
+        // Get real dimensions
+        glfwGetFramebufferSize(window, &WIDTH, &HEIGHT);
 
-    int major, minor, rev;
-    major = glfwGetWindowAttrib(window, GLFW_CONTEXT_VERSION_MAJOR);
-    minor = glfwGetWindowAttrib(window, GLFW_CONTEXT_VERSION_MINOR);
-    rev = glfwGetWindowAttrib(window, GLFW_CONTEXT_REVISION);
+        major = glfwGetWindowAttrib(window, GLFW_CONTEXT_VERSION_MAJOR);
+        minor = glfwGetWindowAttrib(window, GLFW_CONTEXT_VERSION_MINOR);
+        rev = glfwGetWindowAttrib(window, GLFW_CONTEXT_REVISION);
+    }
     printf("OpenGL version recieved: %d.%d.%d\n", major, minor, rev);
     printf("Supported OpenGL is %s\n", (const char *)glGetString(GL_VERSION));
     printf("Supported GLSL is %s\n",
            (const char *)glGetString(GL_SHADING_LANGUAGE_VERSION));
 
+    // 10_10_10_2 normals need GL 3.3 or ARB_vertex_type_2_10_10_10_rev
+    if (vertex_format != VertexFormat::FLOAT && major == 3 && minor < 3 &&
+        !(is_headless ? GLEW_ARB_vertex_type_2_10_10_10_rev
+                      : glfwExtensionSupported(
+                            "GL_ARB_vertex_type_2_10_10_10_rev"))) {
+        std::cout << "Packed normals unsupported, using float vertices"
+                  << std::endl;
+        vertex_format = VertexFormat::FLOAT;
+    }
+
     GLuint VertexArrayID;
     glGenVertexArrays(1, &VertexArrayID);
     check_gl_error();
     glBindVertexArray(VertexArrayID);
     check_gl_error();
 
+    // Start worker threads before any meshes are generated
+    jobs = new JobSystem();
+    NOISE_PARAMS = makeNoiseParams(); // picks up the seed from args
+    bool has_archive =
+        tile_archive_path != "" &&
+        tile_archive.open(tile_archive_path, XMAX, YMAX, TILE_ARCHIVE_CAPACITY,
+                          NOISE_PARAMS);
+    height_cache = new HeightTileCache(
+        XMAX, YMAX, (size_t)(height_cache_mb * 1024 * 1024),
+        generateHeightTile, has_archive ? &tile_archive : nullptr);
+
     // Initialize UI state
     initUIState();
 
@@ -1101,22 +1353,13 @@ int main(int argc, char *argv[]) {
 
     program.init(v_shader.read(), f_shader.read(), g_shader.read(), "outColor");
     program.bind();
+    frame_ubo.init(sizeof(FrameUniforms));
+    frame_ubo.bindBase(FRAME_UNIFORMS_BINDING);
+    program.bindUniformBlock("FrameUniforms", FRAME_UNIFORMS_BINDING);
 
     for (int i = 0; i < meshes.size(); i++) {
         std::cout << "Binding VBO for mesh : " << i << std::endl;
-        Mesh *mesh = &meshes[i];
-        // The vertex shader wants the position of the vertices as an input.
-        // The following line connects the VBO we defined above with the
-        // position "slot" in the vertex shader
-
-        program.bindVertexAttribArray(mesh->vertex_key_name, mesh->VBO);
-
-        // Bind normals buffer
-        program.bindVertexAttribArray(mesh->vertex_normal_key_name,
-                                      mesh->VBO_VN);
-
-        // Bind vertex colors buffer
-        program.bindVertexAttribArray(mesh->vertex_color_key_name, mesh->VBO_C);
+        meshes[i].bindVertexAttributes(program);
     }
 
     // Create initial scene objects
@@ -1132,6 +1375,13 @@ int main(int argc, char *argv[]) {
     // Init index buffer
     initIndexBuffer();
 
+    // Timer queries need GL 3.3 or ARB_timer_query
+    gpu_timer.init(major > 3 || (major == 3 && minor >= 3) ||
+                   (is_headless
+                        ? GLEW_ARB_timer_query
+                        : glfwExtensionSupported("GL_ARB_timer_query")));
+    stats_overlay.init();
+
     // Enable depth test
     glEnable(GL_DEPTH_TEST);
 
@@ -1143,18 +1393,19 @@ int main(int argc, char *argv[]) {
     auto t_start = std::chrono::high_resolution_clock::now();
 
     // Bind callbacks
+    if (!is_headless) {
+        // Register the keyboard callback
+        glfwSetKeyCallback(window, key_callback);
 
-    // Register the keyboard callback
-    glfwSetKeyCallback(window, key_callback);
+        // // Register the mouse callback
+        glfwSetMouseButtonCallback(window, mouse_button_callback);
 
-    // // Register the mouse callback
-    glfwSetMouseButtonCallback(window, mouse_button_callback);
+        // Register the cursor position callback
+        glfwSetCursorPosCallback(window, cursor_position_callback);
 
-    // Register the cursor position callback
-    glfwSetCursorPosCallback(window, cursor_position_callback);
-
-    // Update viewport
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        // Update viewport
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    }
 
     auto t_now = std::chrono::high_resolution_clock::now();
     float time = std::chrono::duration_cast<std::chrono::duration<float>>(
@@ -1163,8 +1414,15 @@ int main(int argc, char *argv[]) {
     float last_frame_change_time = 0.0f;
     int counter = 1;
     int frame_counter = 0;
-    // Loop until the user closes the window
-    while (!glfwWindowShouldClose(window)) {
+    BenchmarkReport report;
+    // Loop until the user closes the window, the headless frames are done or
+    // the replay ends
+    while ((is_headless ? frame_counter < headless_frames
+                        : !glfwWindowShouldClose(window)) &&
+           (!is_replaying ||
+            frame_counter < (int)camera_path.frames.size())) {
+        report.startFrame();
+        ProfileZone frame_zone("frame");
         // std::cout << "keys:";
 
         // Set the uniform value depending on the time difference
@@ -1180,17 +1438,42 @@ int main(int argc, char *argv[]) {
             last_frame_change_time = 0.0f;
         }
 
-        if (frame_counter % KEY_PRESS_THROTTLE_FRAMES == 0) {
-            // Fire keys
-            std::set<int>::iterator it;
-            for (it = KEYS.begin(); it != KEYS.end(); ++it) {
-                if (ASYNC_ENABLED) {
-                    // Asynchronously fire key callbacks
-                    std::async(std::launch::async, handle_key, *it, MODS,
-                               MOVE_SPEED);
-                } else {
-                    handle_key(*it, MODS, MOVE_SPEED);
-                }
+        if (is_replaying) {
+            // Replays ignore the keyboard
+            applyPathFrame(camera_path.frames[frame_counter - 1]);
+        } else if (frame_counter % KEY_PRESS_THROTTLE_FRAMES == 0 &&
+                   !KEYS.empty()) {
+            // Fire keys. Handled here rather than on the workers, since
+            // the frame below reads the state they change.
+            std::vector<int> pressed(KEYS.begin(), KEYS.end());
+            for (int key : pressed) {
+                handle_key(key, MODS, MOVE_SPEED);
+            }
+        }
+
+        if (record_path != "") {
+            recorded_path.frames.push_back(capturePathFrame());
+        }
+        report.lap(BenchmarkReport::INPUT);
+
+        // Swap in tiles generated since the last frame. New tiles may
+        // leave the neighbourhood incomplete, so re-check it.
+        int tiles_uploaded = 0;
+        if (terrain != nullptr) {
+            tiles_uploaded =
+                terrain->uploadReady(scene_objects, TERRAIN_UPLOAD_BUDGET_MS);
+        }
+        if (tiles_uploaded > 0) {
+            requestTerrainUpdate();
+        }
+        report.lap(BenchmarkReport::TERRAIN_UPLOAD);
+
+        // Pass times read back from earlier frames
+        DrawStats draws;
+        gpu_timer.startFrame();
+        for (int p = 0; p < GpuTimer::NUM_PASSES; p++) {
+            if (gpu_timer.hasResult(p)) {
+                report.addGpuTime(GpuTimer::name(p), gpu_timer.ms(p));
             }
         }
 
@@ -1200,7 +1483,7 @@ int main(int argc, char *argv[]) {
             player->setColor(
                 9); // Color VBO_C is somehow dropped when pixel mode is enabled
         } else {
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glBindFramebuffer(GL_FRAMEBUFFER, screen_framebuffer);
         }
 
         glViewport(0, 0, WIDTH, HEIGHT);
@@ -1216,30 +1499,146 @@ int main(int argc, char *argv[]) {
 
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        glUniform1f(program.uniform("time"), time);
-        glUniform1f(program.uniform("delta"), delta);
-        glUniform3f(program.uniform("blinkingColor"),
-                    (float)(sin(time * 4.0f) + 1.0f) / 2.0f, 0.0f, 0.0f);
-
-        glUniform1i(program.uniform("shadingMode"), 0);
-        glUniform3f(program.uniform("backgroundColor"), 0.5f, 0.5f, 0.5f);
-        glUniform3f(program.uniform("lightPosition_world"),
-                    UI_STATE.light_position.x, UI_STATE.light_position.y,
-                    UI_STATE.light_position.z);
-        glUniform2i(program.uniform("iResolution"), WIDTH, HEIGHT);
-        glUniform1f(program.uniform("minElevation"), MIN_ELEVATION);
-        glUniform1f(program.uniform("maxElevation"), MAX_ELEVATION);
-
+        // Per-frame state goes out in one uniform buffer update
+        setViewMatrix();
+        setProjectionMatrix();
+        FrameUniforms frame;
+        frame.view_matrix = ViewMatrix;
+        frame.projection_matrix = ProjectionMatrix;
+        frame.light_position = UI_STATE.light_position;
+        frame.time = time;
+        frame.blinking_color =
+            glm::vec3((float)(sin(time * 4.0f) + 1.0f) / 2.0f, 0.0f, 0.0f);
+        frame.delta = delta;
+        frame.background_color = glm::vec3(0.5f, 0.5f, 0.5f);
+        frame.min_elevation = MIN_ELEVATION;
+        frame.max_elevation = MAX_ELEVATION;
+        frame.grid_width = XMAX;
 // Use special coloring and parameters to debug visuals
 #ifdef DEBUG_VISUALS
-        glUniform1i(program.uniform("DEBUG_VISUALS"), 1);
+        frame.debug_visuals = 1;
 #else
-        glUniform1i(program.uniform("DEBUG_VISUALS"), 0);
+        frame.debug_visuals = 0;
 #endif
+        frame.grid_height = YMAX;
+        frame_ubo.update(&frame);
+
+        glUniform1i(program.uniform("shadingMode"), 0);
         // Texture (end)
 
-        // Loops through each scene object, drawing each one
+        if (terrain != nullptr) {
+            terrain->vertexPool().bind(program, TERRAIN_TEXTURE_UNIT);
+        }
+
+        report.lap(BenchmarkReport::DRAW);
+
+        // Only objects whose bounding sphere touches the view frustum are
+        // submitted below
+        scene_culler.clear();
+        for (int i = 0; i < scene_objects.size(); i++) {
+            SceneObject *so = scene_objects.at(i);
+            glm::vec3 world_center;
+            float world_radius;
+            so->updateModel();
+            so->getWorldBounds(world_center, world_radius);
+            scene_culler.add(world_center, world_radius);
+        }
+        cull_stats = scene_culler.cull(
+            Frustum::fromMatrix(ProjectionMatrix * ViewMatrix), is_visible);
+        report.lap(BenchmarkReport::CULLING);
+
+        // Terrain detail follows screen-space error, not view radius
+        if (terrain != nullptr) {
+            terrain->selectLod(*terrain_lod,
+                               glm::vec3(glm::inverse(ViewMatrix)[3]),
+                               ProjectionMatrix[1][1] * HEIGHT / 2.0f,
+                               ProjectionMatrix[2][3] != 0.0f,
+                               terrain_lod_tolerance_px);
+        }
+        report.lap(BenchmarkReport::TERRAIN_LOD);
+
+        // Batch every terrain tile that shares the first tile's draw state,
+        // one instanced draw per LOD index set. The selected tile (and any
+        // tile toggled to its own shading mode) goes through the per-object
+        // loop below.
+        static std::vector<bool> is_batched;
+        is_batched.assign(scene_objects.size(), false);
+        for (auto &batch : terrain_batches) {
+            batch.second.clear();
+        }
+        SceneObject *batch_ref = nullptr;
+        for (int i = 0; i < scene_objects.size(); i++) {
+            SceneObject *so = scene_objects.at(i);
+            if (!is_visible[i] || so->mesh->id != TERRAIN_MESH_ID ||
+                i == UI_STATE.selected_model_idx) {
+                continue;
+            }
+            if (batch_ref == nullptr) {
+                batch_ref = so;
+            }
+            if (so->shading_mode != batch_ref->shading_mode ||
+                so->vertex_color_blend_amount !=
+                    batch_ref->vertex_color_blend_amount) {
+                continue;
+            }
+            // Terrain scene objects always hold a streamed tile mesh
+            HeightfieldMesh *tile = static_cast<HeightfieldMesh *>(so->mesh);
+            TileLod lod = terrain->tileLod(i);
+            InstanceBatch &batch = terrain_batches[TerrainLod::key(lod)];
+            if (batch.VAO.id == 0) {
+                batch.init(program);
+            }
+            batch.add(so->ModelMatrix, so->color, tile->vertexOffset(),
+                      1 << lod.level, lod.morph);
+            is_batched[i] = true;
+        }
+        gpu_timer.begin(GpuTimer::TERRAIN);
+        if (batch_ref != nullptr) {
+            ProfileZone zone("drawTerrainBatches");
+            glUniform1i(program.uniform("isInstanced"), 1);
+            glUniform1i(program.uniform("isSelected"), 0);
+            glUniform1i(program.uniform("shadingMode"),
+                        batch_ref->shading_mode);
+            glUniform1f(program.uniform("vertexColorBlendAmount"),
+                        batch_ref->vertex_color_blend_amount);
+            glUniform1i(program.uniform("meshID"), TERRAIN_MESH_ID);
+            for (auto &batch : terrain_batches) {
+                batch.second.draw(mesh_index_buffers[TERRAIN_MESH_ID],
+                                  terrain_lod->numIndices(batch.first),
+                                  terrain_lod->firstIndex(batch.first),
+                                  &draws);
+            }
+        }
+        glUniform1i(program.uniform("isInstanced"), 0);
+
+        // The clipmap scrolls with the player, then draws level by level
+        if (clipmap != nullptr) {
+            clipmap->update(player->translation);
+            glm::mat4 identity(1.0f);
+            MVPmatrix = ProjectionMatrix * ViewMatrix;
+            glUniformMatrix4fv(program.uniform("MVPMatrix"), 1, GLFW_FALSE,
+                               &MVPmatrix[0][0]);
+            glUniformMatrix4fv(program.uniform("ModelMatrix"), 1, GLFW_FALSE,
+                               &identity[0][0]);
+            glUniformMatrix4fv(program.uniform("MirrorMatrix"), 1, GLFW_FALSE,
+                               &identity[0][0]);
+            glUniform3f(program.uniform("ModelColor"), GREEN.x, GREEN.y,
+                        GREEN.z);
+            glUniform1i(program.uniform("isSelected"), 0);
+            glUniform1i(program.uniform("shadingMode"), 2); // as tiles
+            glUniform1f(program.uniform("vertexColorBlendAmount"), 0.0f);
+            glUniform1i(program.uniform("meshID"), CLIPMAP_MESH_ID);
+            clipmap->draw(program, CLIPMAP_TEXTURE_UNIT, &draws);
+        }
+        gpu_timer.end();
+
+        // Loops through the remaining scene objects, drawing each one
+        gpu_timer.begin(GpuTimer::OBJECTS);
         for (int i = 0; i < scene_objects.size(); i++) {
+            if (is_batched[i] || !is_visible[i]) {
+                continue;
+            }
+            ProfileZone zone("drawObject", i);
             SceneObject *so = scene_objects.at(i);
             // Apply updates to the selected object
             if (i == UI_STATE.selected_model_idx) {
@@ -1258,8 +1657,8 @@ int main(int argc, char *argv[]) {
             // Find model matrix in the scene objects list
             setModelMatrix(scene_objects, i);
 
-            // Update MVP matrix based on state
-            setMVPMatrix();
+            // View and projection are already set for this frame
+            MVPmatrix = ProjectionMatrix * ViewMatrix * ModelMatrix;
 
             // Send MVP matrix as uniform
             glUniformMatrix4fv(program.uniform("MVPMatrix"), 1, GLFW_FALSE,
@@ -1272,37 +1671,52 @@ int main(int argc, char *argv[]) {
             glUniformMatrix4fv(program.uniform("MirrorMatrix"), 1, GLFW_FALSE,
                                &so->MirrorMatrix[0][0]);
 
-            // Send V matrix as a uniform. TODO: update for multiple models
-            glUniformMatrix4fv(program.uniform("ViewMatrix"), 1, GLFW_FALSE,
-                               &ViewMatrix[0][0]);
-
-            // Send P mattrtix
-            glUniformMatrix4fv(program.uniform("ProjectionMatrix"), 1,
-                               GLFW_FALSE, &ProjectionMatrix[0][0]);
-
             // Set mesh identifier for shader
             glUniform1i(program.uniform("meshID"), so->mesh->id);
+            // Undoes position quantization of meshes loaded from files
+            glUniform3fv(program.uniform("positionScale"), 1,
+                         &so->mesh->position_scale[0]);
+            glUniform3fv(program.uniform("positionOffset"), 1,
+                         &so->mesh->position_offset[0]);
+            unsigned int num_indices = so->mesh->num_indices;
+            size_t first_index = 0;
+            if (so->mesh->id == TERRAIN_MESH_ID) {
+                glUniform1i(
+                    program.uniform("vertexOffset"),
+                    static_cast<HeightfieldMesh *>(so->mesh)->vertexOffset());
+                TileLod lod = terrain->tileLod(i);
+                glUniform1i(program.uniform("lodStep"), 1 << lod.level);
+                glUniform1f(program.uniform("lodMorph"), lod.morph);
+                num_indices = terrain_lod->numIndices(TerrainLod::key(lod));
+                first_index = terrain_lod->firstIndex(TerrainLod::key(lod));
+            }
 
             // TODO: add configurable light position
 
+            // Terrain tiles all share the LOD index buffer of mesh 2
+            so->mesh->VAO.bind();
+
             // DYNAMIC ARRAY BUFFER
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,
-                         mesh_index_buffer_refs[so->mesh->id]);
+            IndexBufferObject &index_buffer = mesh_index_buffers[so->mesh->id];
+            index_buffer.bind();
 
             // // Draw the triangles !
-            glDrawElements(GL_TRIANGLES,             // mode
-                           so->mesh->indices.size(), // count
-                           GL_UNSIGNED_INT,          // type
-                                                     //    &so->mesh->indices[0]
-                           (void *)(0) // element array buffer offset
-            );
+            glDrawElements(GL_TRIANGLES,      // mode
+                           num_indices,       // count
+                           index_buffer.type, // type
+                           // element array buffer offset
+                           index_buffer.offset(first_index));
+            draws.add(num_indices);
         }
+        gpu_timer.end();
 
         // Handle secondary FX processing
         if (UI_STATE.should_use_secondary_renderer) {
+            ProfileZone zone("postProcess");
+            gpu_timer.begin(GpuTimer::POST);
             // glDisableVertexAttribArray(0);
             // Render to screen
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glBindFramebuffer(GL_FRAMEBUFFER, screen_framebuffer);
 
             glViewport(0, 0, WIDTH, HEIGHT);
 
@@ -1317,11 +1731,13 @@ int main(int argc, char *argv[]) {
 
             glUniform1i(quad_program.uniform("renderedTexture"), 0);
             glUniform1f(quad_program.uniform("time"),
-                        (float)(glfwGetTime() * 10.0f));
+                        time * 10.0f);
             glUniform1f(quad_program.uniform("pixelWidth"),
                         UI_STATE.pixel_width);
 
             // 1rst attribute buffer : vertices
+            glBindVertexArray(VertexArrayID);
+            VBO_QUAD.bind();
             glEnableVertexAttribArray(0);
             glVertexAttribPointer(0, // attribute 0. No particular reason for
                                      // but
@@ -1336,17 +1752,39 @@ int main(int argc, char *argv[]) {
             // Draw the triangles !
             glDrawArrays(GL_TRIANGLES, 0,
                          6); // 2*3 indices starting at 0 -> 2 triangles
+            draws.add(6);
+            gpu_timer.end();
 
             // glDisableVertexAttribArray(0);
         }
 
+        int tiles_resident = terrain != nullptr ? terrain->residentTiles() : 0;
+        if (UI_STATE.should_show_stats) {
+            const FrameTimings &frames = report.frames();
+            updateStatsOverlay(
+                frames.count() > 0 ? frames[frames.count() - 1] : 0.0f, draws,
+                tiles_resident);
+            stats_overlay.draw(WIDTH, HEIGHT);
+        }
+
         // glDisableVertexAttribArray(0);
 
-        // Swap front and back buffers
-        glfwSwapBuffers(window);
+        report.lap(BenchmarkReport::DRAW);
+        if (is_headless) {
+            ProfileZone zone("finishFrame");
+            headless.finishFrame();
+        } else {
+            // Swap front and back buffers
+            {
+                ProfileZone zone("glfwSwapBuffers");
+                glfwSwapBuffers(window);
+            }
 
-        // Poll for and process events
-        glfwPollEvents();
+            // Poll for and process events
+            glfwPollEvents();
+        }
+        report.lap(BenchmarkReport::PRESENT);
+        report.endFrame(tiles_uploaded, draws, cull_stats, tiles_resident);
 
         if (DEBUG_MODE_ENABLED) {
             // DEBUG: renders a few test frames then exits early to see glsl
@@ -1359,15 +1797,70 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    // Stop workers before tearing down the scene they operate on
+    delete jobs;
+    jobs = nullptr;
+
+    if (Profiler::isCapturing()) {
+        toggleTrace(); // writes it
+    }
+    if (record_path != "" && recorded_path.save(record_path)) {
+        std::cout << "Recorded " << recorded_path.frames.size()
+                  << " frames to " << record_path << std::endl;
+    }
+    if (is_headless || is_replaying) {
+        std::cout << report.frames() << std::endl;
+    }
+    if (report_path != "") {
+        if (terrain != nullptr) {
+            TileBuildStats builds = terrain->buildStats();
+            report.setTileBuilds(builds.built, builds.total_ms,
+                                 builds.max_ms);
+        }
+        if (report.writeJson(report_path,
+                             is_replaying ? replay_path : "interactive",
+                             WIDTH, HEIGHT)) {
+            std::cout << "Wrote " << report_path << std::endl;
+        }
+    }
+    for (auto &batch : terrain_batches) {
+        batch.second.free();
+    }
+    delete terrain_lod;
+    terrain_lod = nullptr;
+    if (terrain != nullptr) {
+        terrain->vertexPool().free();
+        delete terrain;
+        terrain = nullptr;
+    }
+    if (clipmap != nullptr) {
+        clipmap->free();
+        delete clipmap;
+        clipmap = nullptr;
+    }
+    std::cout << height_cache->stats() << std::endl;
+    delete height_cache;
+    height_cache = nullptr;
+    tile_archive.close();
+
     // Deallocate opengl memory
+    frame_ubo.free();
     program.free();
     quad_program.free();
+    gpu_timer.free();
+    stats_overlay.free();
 
     for (int i = 0; i < meshes.size(); i++) {
         Mesh *m = &meshes[i];
         m->VBO.free();
         m->VBO_VN.free();
         m->VBO_C.free();
+        mesh_index_buffers[i].free(); // includes the cached meshes' IBO
+    }
+
+    if (is_headless) {
+        headless.free();
+        return 0;
     }
 
     // Deallocate glfw internals
@@ -0,0 +1,385 @@
+// Microbenchmarks of the CPU hot paths: terrain noise, heightfield tiles,
+// mesh parsing, triangle reordering and vertex packing. Runs without a GL
+// context, so kernels can be timed in isolation before and after a change.
+//
+// Usage: infinityterrain_bench [-k <filter>] [-t <seconds>] [-j 0|1]
+//                              [mesh.obj|mesh.off]...
+//   -k <filter>   only run cases whose name contains filter
+//   -t <seconds>  minimum time spent on each case (default 0.25)
+//   -j 0|1        also time the job system variants (default 1)
+//   meshes        assets to time on top of the generated grids
+//
+// Before timing, the SIMD noise rows are checked against the scalar kernel
+// and the run fails if any sample differs. Each case reports the median and
+// fastest run and the throughput of the median run. Generated grid OBJs are
+// written to a private directory under $TMPDIR (or /tmp), removed with it
+// afterwards.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <HeightfieldMesh.h>
+#include <JobSystem.h>
+#include <Mesh.h>
+#include <MeshOptimizer.h>
+#include <Noise.h>
+#include <TerrainNoise.h>
+#include <VertexFormat.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+const unsigned int TILE_SIZES[] = {17, 33, 65, 129, 257};
+const unsigned int GRID_SIZES[] = {33, 129, 513}; // vertices per side
+const int MIN_RUNS = 3;
+const int MAX_RUNS = 1000;
+
+NoiseParams noise_params;
+JobSystem *bench_jobs = nullptr; // jobs the tile callbacks hand work to
+
+// Mesh with its geometry left to the benchmarks
+class BenchMesh : public Mesh {
+  public:
+    BenchMesh(JobSystem *_job_system) { job_system = _job_system; }
+    BenchMesh(unsigned int w, unsigned int h, JobSystem *_job_system) {
+        width = w;
+        height = h;
+        job_system = _job_system;
+        noise_row_d_callback = noiseRowD;
+    }
+
+    static void noiseRowD(const float *xs, float y, unsigned int n,
+                          float *out, float *dx, float *dy) {
+        terrainHeightRowD(xs, y, n, noise_params, out, dx, dy);
+    }
+};
+
+void heightTile(glm::ivec2 grid_origin, unsigned int w, unsigned int h,
+                float *out) {
+    glm::ivec2 cell(grid_origin.x / (int)(w - 1), grid_origin.y / (int)(h - 1));
+    terrainHeightCell(noise_params, bench_jobs, cell, w, h, out);
+}
+
+void slopeTile(glm::ivec2 grid_origin, unsigned int w, unsigned int h,
+               float *slopes) {
+    terrainSlopeTile(noise_params, bench_jobs, grid_origin, w, h, slopes);
+}
+
+class Bench {
+  private:
+    typedef std::chrono::high_resolution_clock Clock;
+
+    std::string filter;
+    double min_seconds;
+    std::ostringstream muted; // swallows the logging of the timed code
+
+  public:
+    Bench(const std::string &_filter, double _min_seconds)
+        : filter(_filter), min_seconds(_min_seconds) {
+        std::cout << std::left << std::setw(40) << "case" << std::right
+                  << std::setw(8) << "runs" << std::setw(12) << "median ms"
+                  << std::setw(12) << "min ms" << std::setw(22) << "throughput"
+                  << std::endl;
+    }
+
+    // Runs fn with its logging swallowed, for setup outside the timings
+    bool quietly(std::function<bool()> fn) {
+        std::streambuf *out = std::cout.rdbuf(muted.rdbuf());
+        bool result = fn();
+        std::cout.rdbuf(out);
+        muted.str("");
+        return result;
+    }
+
+    // Times fn, which handles items of unit per call
+    void run(const std::string &name, double items, const std::string &unit,
+             std::function<void()> fn) {
+        if (name.find(filter) == std::string::npos) {
+            return;
+        }
+        std::vector<double> runs_ms;
+        double total_ms = 0.0;
+        std::streambuf *out = std::cout.rdbuf(muted.rdbuf());
+        while ((int)runs_ms.size() < MIN_RUNS ||
+               (total_ms < min_seconds * 1000.0 &&
+                (int)runs_ms.size() < MAX_RUNS)) {
+            Clock::time_point start = Clock::now();
+            fn();
+            double ms = std::chrono::duration<double, std::milli>(
+                            Clock::now() - start)
+                            .count();
+            runs_ms.push_back(ms);
+            total_ms += ms;
+            muted.str("");
+        }
+        std::cout.rdbuf(out);
+
+        std::sort(runs_ms.begin(), runs_ms.end());
+        double median = runs_ms[runs_ms.size() / 2];
+        std::ostringstream throughput;
+        throughput << std::setprecision(3) << items / median / 1000.0 << " M"
+                   << unit << "/s";
+        std::cout << std::left << std::setw(40) << name << std::right
+                  << std::setw(8) << runs_ms.size() << std::fixed
+                  << std::setprecision(3) << std::setw(12) << median
+                  << std::setw(12) << runs_ms[0] << std::setw(22)
+                  << throughput.str() << std::endl;
+        std::cout.unsetf(std::ios::fixed);
+    }
+};
+
+// Writes an n x n vertex grid with a little relief as an OBJ
+bool writeGridObj(const std::string &path, unsigned int n) {
+    std::ofstream out(path);
+    for (unsigned int r = 0; r < n; r++) {
+        for (unsigned int c = 0; c < n; c++) {
+            out << "v " << c << " " << (float)((c * 7 + r * 13) % 17) / 17.0f
+                << " " << r << "\n";
+        }
+    }
+    for (unsigned int r = 0; r + 1 < n; r++) {
+        for (unsigned int c = 0; c + 1 < n; c++) {
+            unsigned int v = r * n + c + 1; // OBJ indices start at 1
+            out << "f " << v << " " << v + n << " " << v + 1 << "\n";
+            out << "f " << v + n << " " << v + n + 1 << " " << v + 1 << "\n";
+        }
+    }
+    return (bool)out;
+}
+
+// Creates a fresh directory for the generated grids, or returns "" if it
+// can't
+std::string makeTempDir() {
+#ifdef _WIN32
+    return "";
+#else
+    const char *tmp = std::getenv("TMPDIR");
+    std::string pattern = std::string(tmp != nullptr && *tmp ? tmp : "/tmp") +
+                          "/infinityterrain_bench.XXXXXX";
+    std::vector<char> name(pattern.begin(), pattern.end());
+    name.push_back('\0');
+    if (mkdtemp(name.data()) == nullptr) {
+        return "";
+    }
+    return name.data();
+#endif
+}
+
+std::string baseName(const std::string &path) {
+    std::string::size_type slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+// Checks that the SIMD row kernels return the very bits of the scalar ones,
+// which tiles rely on to meet without seams
+bool checkNoiseRows() {
+    const unsigned int w = 67; // not a multiple of the lanes: has a tail
+    std::vector<float> xs(w), row(w), row_dx(w), row_dz(w);
+    unsigned int num_mismatches = 0;
+    for (unsigned int r = 0; r < 64; r++) {
+        float y = (float)r / 17.0f - 2.0f;
+        for (unsigned int c = 0; c < w; c++) {
+            xs[c] = (float)(c + 5 * r) / 31.0f - 3.0f;
+        }
+        terrainHeightRow(&xs[0], y, w, noise_params, &row[0]);
+        for (unsigned int c = 0; c < w; c++) {
+            float height = terrainHeight(xs[c], y, noise_params);
+            num_mismatches += memcmp(&height, &row[c], sizeof(float)) != 0;
+        }
+        terrainHeightRowD(&xs[0], y, w, noise_params, &row[0], &row_dx[0],
+                          &row_dz[0]);
+        for (unsigned int c = 0; c < w; c++) {
+            float d[3];
+            d[0] = terrainHeightD(xs[c], y, noise_params, d[1], d[2]);
+            float row_d[3] = {row[c], row_dx[c], row_dz[c]};
+            num_mismatches += memcmp(d, row_d, sizeof(d)) != 0;
+        }
+    }
+    if (num_mismatches > 0) {
+        std::cout << "ERROR: " << num_mismatches
+                  << " noise row samples differ from the scalar kernel"
+                  << " (built with FMA contraction?)" << std::endl;
+    }
+    return num_mismatches == 0;
+}
+
+void benchNoise(Bench &bench, JobSystem *jobs) {
+    for (unsigned int w : TILE_SIZES) {
+        std::string size = std::to_string(w);
+        std::vector<float> xs(w);
+        std::vector<float> out(w * w);
+        std::vector<float> dx(w);
+        std::vector<float> dz(w);
+        for (unsigned int c = 0; c < w; c++) {
+            xs[c] = (float)c / w;
+        }
+        bench.run("noise/row/" + size, w, "samples", [&] {
+            terrainHeightRow(&xs[0], 0.5f, w, noise_params, &out[0]);
+        });
+        bench.run("noise/row_d/" + size, w, "samples", [&] {
+            terrainHeightRowD(&xs[0], 0.5f, w, noise_params, &out[0], &dx[0],
+                              &dz[0]);
+        });
+
+        std::vector<float> slopes(w * w * 2);
+        const char *variants[] = {"", "_jobs"};
+        JobSystem *variant_jobs[] = {nullptr, jobs};
+        for (int v = 0; v < 2; v++) {
+            if (v > 0 && jobs == nullptr) {
+                continue;
+            }
+            std::string suffix = std::string(variants[v]) + "/" + size;
+            bench.run("tile/height" + suffix, w * w, "samples", [&] {
+                terrainHeightCell(noise_params, variant_jobs[v],
+                                  glm::ivec2(3, 5), w, w, &out[0]);
+            });
+            bench.run("tile/slope" + suffix, w * w, "samples", [&] {
+                terrainSlopeTile(noise_params, variant_jobs[v],
+                                 glm::ivec2(3 * (w - 1), 5 * (w - 1)), w, w,
+                                 &slopes[0]);
+            });
+        }
+    }
+}
+
+void benchHeightfields(Bench &bench, JobSystem *jobs) {
+    for (unsigned int w : TILE_SIZES) {
+        std::string size = std::to_string(w);
+        glm::ivec2 origin(3 * (w - 1), 5 * (w - 1));
+
+        bench_jobs = nullptr;
+        HeightfieldMesh tile(0, w, w, heightTile, slopeTile, origin, nullptr,
+                             0);
+        bench.run("heightfield/build/" + size, w * w, "vertices",
+                  [&] { tile.build(); });
+        if (jobs != nullptr) {
+            bench_jobs = jobs;
+            bench.run("heightfield/build_jobs/" + size, w * w, "vertices",
+                      [&] { tile.build(); });
+            bench_jobs = nullptr;
+        }
+
+        // The procedural mesh path: grid and analytic normals on the CPU
+        if (w > 129) {
+            continue;
+        }
+        BenchMesh mesh(w, w, nullptr);
+        mesh.grid_origin = origin;
+        bench.run("mesh/heightfield/" + size, w * w, "vertices",
+                  [&] { mesh.buildHeightfield(w, w); });
+    }
+}
+
+void benchMeshFile(Bench &bench, JobSystem *jobs, const std::string &path,
+                   const std::string &label) {
+    BenchMesh parsed(jobs);
+    if (!bench.quietly([&] { return parsed.parseFile(path); })) {
+        std::cout << "ERROR: could not parse " << path << std::endl;
+        return;
+    }
+    double num_faces = parsed.faces.size();
+    double num_vertices = parsed.vertices.size();
+
+    bench.run("parse/" + label, num_faces, "triangles", [&] {
+        BenchMesh mesh(nullptr);
+        mesh.parseFile(path);
+    });
+    if (jobs != nullptr) {
+        bench.run("parse_jobs/" + label, num_faces, "triangles", [&] {
+            BenchMesh mesh(jobs);
+            mesh.parseFile(path);
+        });
+    }
+    bench.run("optimize/" + label, num_faces, "triangles", [&] {
+        MeshOptimizer::optimize(parsed.faces, parsed.vertices);
+    });
+    bench.run("optimize/analyze/" + label, num_faces, "triangles", [&] {
+        MeshOptimizer::analyze(parsed.faces, parsed.vertices.size());
+    });
+
+    int formats[] = {VertexFormat::FLOAT, VertexFormat::HALF,
+                     VertexFormat::QUANTIZED};
+    std::vector<unsigned char> packed;
+    for (int format : formats) {
+        parsed.vertex_format = format;
+        bench.run(std::string("pack/") + VertexFormat::name(format) + "/" +
+                      label,
+                  num_vertices, "vertices", [&] { parsed.packVertices(packed); });
+    }
+}
+
+// Times the parsing path on generated grids, written to a temporary
+// directory that is removed afterwards
+void benchGrids(Bench &bench, JobSystem *jobs) {
+    std::string grid_dir = makeTempDir();
+    if (grid_dir.empty()) {
+        std::cout << "ERROR: could not create a temporary directory, "
+                     "skipping the grids"
+                  << std::endl;
+        return;
+    }
+    for (unsigned int n : GRID_SIZES) {
+        std::string label = "grid" + std::to_string(n);
+        std::string path = grid_dir + "/" + label + ".obj";
+        if (writeGridObj(path, n)) {
+            benchMeshFile(bench, jobs, path, label);
+        } else {
+            std::cout << "ERROR: could not write " << path << std::endl;
+        }
+        std::remove(path.c_str());
+    }
+#ifndef _WIN32
+    rmdir(grid_dir.c_str());
+#endif
+}
+
+int main(int argc, char *argv[]) {
+    std::string filter;
+    double min_seconds = 0.25;
+    bool should_use_jobs = true;
+    std::vector<std::string> assets;
+    for (int arg_idx = 1; arg_idx < argc; arg_idx++) {
+        std::string arg = argv[arg_idx];
+        if (arg == "-k" && arg_idx + 1 < argc) {
+            filter = argv[++arg_idx];
+        } else if (arg == "-t" && arg_idx + 1 < argc) {
+            min_seconds = std::stod(argv[++arg_idx]);
+        } else if (arg == "-j" && arg_idx + 1 < argc) {
+            should_use_jobs = std::stoi(argv[++arg_idx]) != 0;
+        } else if (arg[0] == '-') {
+            std::cout << "Usage: " << argv[0]
+                      << " [-k filter] [-t seconds] [-j 0|1]"
+                      << " [mesh.obj|mesh.off]..." << std::endl;
+            return 1;
+        } else {
+            assets.push_back(arg);
+        }
+    }
+
+    if (!checkNoiseRows()) {
+        return 1;
+    }
+
+    JobSystem jobs;
+    JobSystem *bench_job_system = should_use_jobs ? &jobs : nullptr;
+    Bench bench(filter, min_seconds);
+
+    benchNoise(bench, bench_job_system);
+    benchHeightfields(bench, bench_job_system);
+    benchGrids(bench, bench_job_system);
+    for (const std::string &path : assets) {
+        benchMeshFile(bench, bench_job_system, path, baseName(path));
+    }
+    return 0;
+}
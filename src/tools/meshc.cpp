@@ -0,0 +1,72 @@
+// Mesh cache converter: parses OBJ / OFF files and writes the binary
+// "<file>.mesh" caches the renderer loads instead of the source.
+//
+// Usage: infinityterrain_meshc [-f] [-vf <format>] [-mo 0|1]
+//                              <mesh.obj|mesh.off>...
+//   -f            rebuild caches that are already fresh
+//   -vf <format>  vertex layout: float, half or q16 (default, as the
+//                 renderer's -vf); a cache is only used with its layout
+//   -mo 0|1       reorder triangles for the vertex cache and overdraw
+//                 (default 1), printing the ACMR / ATVR before and after;
+//                 like -vf, it must match the renderer's -mo
+
+#include <iostream>
+#include <string>
+
+#include <JobSystem.h>
+#include <Mesh.h>
+#include <MeshCache.h>
+#include <VertexFormat.h>
+
+int main(int argc, char *argv[]) {
+    bool should_force = false;
+    int vertex_format = VertexFormat::QUANTIZED;
+    bool should_optimize = true;
+    int num_failed = 0;
+    int num_files = 0;
+    JobSystem jobs;
+    for (int arg_idx = 1; arg_idx < argc; arg_idx++) {
+        std::string path = argv[arg_idx];
+        if (path == "-f") {
+            should_force = true;
+            continue;
+        }
+        if (path == "-vf" && arg_idx + 1 < argc) {
+            vertex_format = VertexFormat::parse(argv[++arg_idx]);
+            if (vertex_format < 0) {
+                std::cout << "ERROR: unknown vertex format " << argv[arg_idx]
+                          << std::endl;
+                return 1;
+            }
+            continue;
+        }
+        if (path == "-mo" && arg_idx + 1 < argc) {
+            should_optimize = std::stoi(argv[++arg_idx]) != 0;
+            continue;
+        }
+        num_files++;
+        MeshCache cache;
+        if (!should_force && cache.open(path, vertex_format, should_optimize)) {
+            std::cout << MeshCache::pathFor(path) << " is up to date"
+                      << std::endl;
+            continue;
+        }
+        cache.close();
+        if (!Mesh::convertToCache(path, &jobs, vertex_format,
+                                  should_optimize)) {
+            std::cout << "ERROR: could not convert " << path << std::endl;
+            num_failed++;
+            continue;
+        }
+        std::cout << "Wrote " << MeshCache::pathFor(path) << " ("
+                  << VertexFormat::name(vertex_format) << ")" << std::endl;
+    }
+    if (num_files == 0) {
+        std::cout << "Usage: " << argv[0]
+                  << " [-f] [-vf float|half|q16] [-mo 0|1]"
+                  << " <mesh.obj|mesh.off>..."
+                  << std::endl;
+        return 1;
+    }
+    return num_failed > 0 ? 1 : 0;
+}